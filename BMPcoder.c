@@ -1,8 +1,72 @@
+#define _XOPEN_SOURCE 700
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
+#include <signal.h>
+#include <limits.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "bitModul.h"
 #include "bmpFileParser.h"
+#include "reedSolomon.h"
+#include "checksum.h"
+#include "payloadFormat.h"
+#include "steganalysis.h"
+#include "container.h"
+#include "jobControl.h"
+#include "workQueue.h"
+#include "folderWatch.h"
+#include "memoryBudget.h"
+#include "resultCache.h"
+
+//The amount of data bytes read at a time when streaming a file.
+#define STREAM_CHUNK (1 << 20)
+
+//The smallest data area encoded with the pipeEncode()-function.
+#define PIPE_THRESHOLD (64 << 20)
+
+//The job controlling the parsing and the writing of the bitmaps.
+JOB_CONTROL job;
+
+//The cache of the results, or NULL if the results are not cached.
+RESULT_CACHE* cache = NULL;
+
+//1 if the bitmaps should not be left in the page cache.
+int dropPageCache = 0;
+
+//The kinds of decoded messages stored in the cache. A decoded message
+//is stored after its kind and the amount of corrected bytes.
+#define DECODED_LEGACY 0
+#define DECODED_CHECKED 1
+#define DECODED_PREFIX 5
+
+//The options given to the program after the file name.
+typedef struct{
+	int headered;			//0 if the message should be written without a header
+	PAYLOAD_INFO payload;	//The options for the headered payload
+
+	int entries;									//The amount of container entries to be encoded
+	char* entryNames[CONTAINER_MAX_ENTRIES];		//The names of the entries
+	char* entryFiles[CONTAINER_MAX_ENTRIES];		//The files holding the entries
+	char* entry;									//The name of the entry to be decoded
+	int ranged;										//1 if only a range of the message should be decoded
+	uint32_t rangeStart, rangeLength;				//The range to be decoded
+	double timeout;									//The time limit in seconds, 0 for none
+	int progress;									//1 if the progress should be printed
+
+	char* output;									//The output directory of the watch mode
+	char* message;									//The file holding the message for the watch mode
+	int decode;										//1 if the watch mode should decode instead of encode
+	int workers;									//The amount of worker threads, 0 for one per processor
+	uint64_t memory;								//The memory budget in bytes, 0 for none
+	char* cacheDirectory;							//The directory of the result cache, or NULL
+	uint64_t cacheLimit;							//The size limit of the cache, 0 for the default
+	int verify;										//1 if the encoded files should be verified
+	int dropCache;									//1 if the files should not be left in the page cache
+}OPTIONS;
 
 //Prints a message explaining the use of this program.
 void help(){
@@ -10,6 +74,61 @@ void help(){
 	printf("The first parameter must specify the operation to be conducted, decoding(-d) or encoding(-e). The second parameter must specify the file on wich the operation will be applied.\n");
 	printf("e.g.\nBMPcoder -e normalBitmap.bmp or\n");
 	printf("BMPcoder -d BMPwithMessage.bmp\n");
+	printf("The message is stored after a header wich holds a checksum of the message.\n");
+	printf("Files with a header can be checked with:\n");
+	printf("BMPcoder -v file1.bmp file2.bmp ...\n");
+	printf("and can also be modified in place:\n");
+	printf("BMPcoder -a BMPwithMessage.bmp appends to the message in the file,\n");
+	printf("BMPcoder -r BMPwithMessage.bmp replaces the message in the file.\n");
+	printf("Files can be screened for messages hidden by any program with:\n");
+	printf("BMPcoder -s file1.bmp file2.bmp ...\n");
+	printf("The score printed for each file is between 0 and 1, higher meaning a message is more likely.\n");
+	printf("The size and the capacity of files can be printed as JSON lines with:\n");
+	printf("BMPcoder -i file1.bmp file2.bmp ... or BMPcoder -i - to read the file names from the standard input.\n");
+	printf("Options for encoding:\n");
+	printf("--legacy        writes the message without a header like older versions did.\n");
+	printf("--fec [parity]  protects the message with Reed-Solomon error correction.\n");
+	printf("                parity is the amount of parity bytes per 255 byte codeword\n");
+	printf("                (an even number between 2 and 128, %d by default).\n", DEFAULT_FEC_PARITY);
+	printf("--matrix [k]    uses matrix embedding, each block of 2^k - 1 bytes carries\n");
+	printf("                k bits and atmost one byte per block is changed\n");
+	printf("                (k between %d and %d, %d by default).\n", MATRIX_MIN_K, MATRIX_MAX_K, DEFAULT_MATRIX_K);
+	printf("--adaptive      embeds the message only to the blocks of the image with the\n");
+	printf("                most texture, where the changes are the hardest to detect.\n");
+	printf("                Can be combined with --fec but not with --matrix or --add.\n");
+	printf("--add NAME=FILE encodes the contents of FILE as an entry called NAME instead of\n");
+	printf("                reading a message, can be given several times. With --fec\n");
+	printf("                each entry is protected separately, the directory of the\n");
+	printf("                entries only has a checksum and is not corrected.\n");
+	printf("Options for decoding:\n");
+	printf("--entry NAME    decodes only the entry called NAME, decoding a file with\n");
+	printf("                entries without this option lists the entries.\n");
+	printf("--range S:L     decodes only the L bytes of the message starting from byte S\n");
+	printf("                and writes them as is to the standard output.\n");
+	printf("A directory can be watched for new bitmaps with:\n");
+	printf("BMPcoder -w directory --message file.txt [-o outputDirectory] [-j workers]\n");
+	printf("Each bitmap written or moved to the directory is encoded with the message as soon\n");
+	printf("as it has been written. With --decode the bitmaps are decoded instead.\n");
+	printf("--memory SIZE   keeps the memory used by the workers under SIZE bytes (with an\n");
+	printf("                optional K, M or G suffix). A bitmap waits until the other\n");
+	printf("                workers have released enough memory, and large bitmaps are\n");
+	printf("                read only partly. Can also be given to -v before the files:\n");
+	printf("                BMPcoder -v [-j workers] [--memory SIZE] file1.bmp ...\n");
+	printf("Options for both:\n");
+	printf("--timeout S     stops reading or writing the bitmap after S seconds.\n");
+	printf("--progress      prints the progress of reading and writing the bitmap.\n");
+	printf("--no-page-cache drops the bitmaps read and written from the page cache as\n");
+	printf("                they are handled, so large batches do not push the data of\n");
+	printf("                other programs out of the memory. Also works with -v.\n");
+	printf("--verify        checks each encoded file: the message is read back from the\n");
+	printf("                encoded data before writing, and after writing the checksum\n");
+	printf("                of the written data bytes is compared with the file on disk.\n");
+	printf("--cache DIR     keeps the encoded bitmaps and the decoded messages in DIR, so\n");
+	printf("                encoding the same bitmap with the same message and options, or\n");
+	printf("                decoding the same bitmap, again copies the earlier result.\n");
+	printf("--cache-size SIZE  the size limit of the cache (1G by default), the least\n");
+	printf("                recently used results are removed first.\n");
+	printf("Pressing Ctrl-C stops the operation without leaving a partial output file.\n");
 }
 
 //Prints (hopefully) a helpfull error message.
@@ -49,6 +168,16 @@ void error(BMP_FILE* file){
 			puts("Internal program error.\nA function that requires the BMP_FILE's header to be parsed received a BMP_FILE wichs header was not parsesd.\n");
 			break;
 
+		case JOB_CANCELLED_ERROR:
+			printf("The operation was cancelled after %llu of %llu bytes.\n\n",
+				(unsigned long long) file->control->done, (unsigned long long) file->control->total);
+			break;
+
+		case JOB_DEADLINE_ERROR:
+			printf("The operation did not finish in time, it was stopped after %llu of %llu bytes.\n\n",
+				(unsigned long long) file->control->done, (unsigned long long) file->control->total);
+			break;
+
 		default:
 			puts("Internal program error.\nError function called on a BMP_FILE with an unknown value in the error variable.\n");
 	}
@@ -56,107 +185,1994 @@ void error(BMP_FILE* file){
 	closeBmp(file);
 }
 
-//Parses a BMP_FILE struct from the given filename and checks 
-//for various error conditions.
-int bmpErrors(char* fName, BMP_FILE** fileP){
+//Prints an error message for a failed payload operation.
+void payloadError(PAYLOAD_INFO* info){
+	switch(info->error){
+
+		case PAYLOAD_OK:
+			break;
+
+		case PAYLOAD_NO_HEADER:
+			puts("The file does not contain a message header.\n");
+			break;
+
+		case PAYLOAD_TOO_LARGE:
+			puts("The message is too long to be encoded to this file.\n");
+			break;
+
+		case PAYLOAD_INVALID_OPTIONS:
+			puts("The encoding options are not valid. Check the program output for usage instructions.\n");
+			break;
+
+		case PAYLOAD_UNCORRECTABLE:
+			puts("The message within the file is damaged too badly to be corrected.\n");
+			break;
+
+		case PAYLOAD_MEMORY_ERROR:
+			puts("There is not enough free memory on the system for the program to function properly.\n");
+			break;
+
+		case PAYLOAD_CHECKSUM_ERROR:
+			puts("The message within the file is damaged or truncated, it does not match its checksum.\n");
+			break;
+
+		case PAYLOAD_OUT_OF_RANGE:
+			puts("The requested bytes are not within the message.\n");
+			break;
+
+		case PAYLOAD_NOT_APPENDABLE:
+			puts("The message within the file is protected with error correction, embedded adaptively or holds entries and can not be appended to. Use replacing instead.\n");
+			break;
+
+		case PAYLOAD_NOT_SEEKABLE:
+			puts("The message within the file is embedded adaptively and can only be decoded as a whole.\n");
+			break;
+
+		default:
+			puts("Internal program error.\nUnknown payload error.\n");
+	}
+}
+
+//Prints an error message for a failed container operation.
+void containerError(CONTAINER* dir){
+	switch(dir->error){
+
+		case CONTAINER_OK:
+			break;
+
+		case CONTAINER_INVALID_DIRECTORY:
+			puts("The directory of the entries within the file is damaged.\n");
+			break;
+
+		case CONTAINER_INVALID_ENTRY:
+			printf("The entry names must be unique and atmost %d characters long.\n\n", CONTAINER_NAME_LENGTH);
+			break;
+
+		case CONTAINER_TOO_MANY_ENTRIES:
+			printf("Atmost %d entries can be encoded to a file.\n\n", CONTAINER_MAX_ENTRIES);
+			break;
+
+		case CONTAINER_UNCORRECTABLE:
+			puts("The entry within the file is damaged too badly to be corrected.\n");
+			break;
+
+		case CONTAINER_CHECKSUM_ERROR:
+			puts("The entry within the file is damaged, it does not match its checksum.\n");
+			break;
+
+		case CONTAINER_MEMORY_ERROR:
+			puts("There is not enough free memory on the system for the program to function properly.\n");
+			break;
+
+		default:
+			puts("Internal program error.\nUnknown container error.\n");
+	}
+}
+
+//Parses a whole number between min and max. Returns 0 if the text
+//is not such a number.
+int parseNumber(char* text, long min, long max, long* value){
+	char* end;
+
+	errno = 0;
+	*value = strtol(text, &end, 10);
+	return end != text && *end == '\0' && errno == 0 && *value >= min && *value <= max;
+}
+
+//Parses a size in bytes, optionally followed by K, M or G.
+//Returns 0 if the size is not valid.
+uint64_t parseSize(char* text){
+	char* end;
+	int shift = 0;
+
+	//strtoull() would accept a negative size and wrap it.
+	if(strchr(text, '-') != NULL)
+		return 0;
+
+	errno = 0;
+	unsigned long long size = strtoull(text, &end, 10);
+	if(end == text || errno == ERANGE)
+		return 0;
+
+	switch(*end){
+		case 'k': case 'K': shift = 10; end++; break;
+		case 'm': case 'M': shift = 20; end++; break;
+		case 'g': case 'G': shift = 30; end++; break;
+	}
+	if(*end != '\0' || size > UINT64_MAX >> shift)
+		return 0;
+
+	return size << shift;
+}
+
+//Parses the options following the file name. Returns 0 if
+//an unknown option was given.
+int parseOptions(int argc, char** argv, OPTIONS* options){
+	memset(options, 0, sizeof(OPTIONS));
+	options->headered = 1;
+
+	for(int i = 3; i < argc; i++){
+		if(strcasecmp(argv[i], "--fec") == 0){
+			options->headered = 1;
+			options->payload.flags |= PAYLOAD_FLAG_FEC;
+			options->payload.fecParity = DEFAULT_FEC_PARITY;
+
+			if(i + 1 < argc && argv[i + 1][0] != '-'){
+				long parity;
+
+				if(!parseNumber(argv[++i], 2, MAX_FEC_PARITY, &parity) || parity % 2 != 0){
+					printf("Invalid amount of parity bytes %s, it must be an even number between 2 and %d.\n", argv[i], MAX_FEC_PARITY);
+					return 0;
+				}
+				options->payload.fecParity = (uint8_t) parity;
+			}
+		}
+		else if(strcasecmp(argv[i], "--matrix") == 0){
+			options->headered = 1;
+			options->payload.flags |= PAYLOAD_FLAG_MATRIX;
+			options->payload.matrixK = DEFAULT_MATRIX_K;
+
+			if(i + 1 < argc && argv[i + 1][0] != '-'){
+				long k;
+
+				if(!parseNumber(argv[++i], MATRIX_MIN_K, MATRIX_MAX_K, &k)){
+					printf("Invalid matrix embedding k %s, it must be between %d and %d.\n", argv[i], MATRIX_MIN_K, MATRIX_MAX_K);
+					return 0;
+				}
+				options->payload.matrixK = (uint8_t) k;
+			}
+		}
+		else if(strcasecmp(argv[i], "--adaptive") == 0){
+			options->headered = 1;
+			options->payload.flags |= PAYLOAD_FLAG_ADAPTIVE;
+		}
+		else if(strcasecmp(argv[i], "--legacy") == 0){
+			options->headered = 0;
+		}
+		else if(strcasecmp(argv[i], "--add") == 0 && i + 1 < argc){
+			char* separator = strchr(argv[++i], '=');
+
+			if(separator == NULL || options->entries == CONTAINER_MAX_ENTRIES){
+				printf("Invalid entry %s\n", argv[i]);
+				return 0;
+			}
+			*separator = '\0';
+			options->entryNames[options->entries] = argv[i];
+			options->entryFiles[options->entries++] = separator + 1;
+		}
+		else if(strcasecmp(argv[i], "--entry") == 0 && i + 1 < argc){
+			options->entry = argv[++i];
+		}
+		else if(strcasecmp(argv[i], "--timeout") == 0 && i + 1 < argc){
+			char* end;
+
+			errno = 0;
+			options->timeout = strtod(argv[++i], &end);
+			if(end == argv[i] || *end != '\0' || errno != 0 || !(options->timeout >= 0 && options->timeout <= 1e9)){
+				printf("Invalid timeout %s\n", argv[i]);
+				return 0;
+			}
+		}
+		else if(strcasecmp(argv[i], "--progress") == 0){
+			options->progress = 1;
+		}
+		else if(strcasecmp(argv[i], "--verify") == 0){
+			options->verify = 1;
+		}
+		else if(strcasecmp(argv[i], "--no-page-cache") == 0){
+			options->dropCache = 1;
+		}
+		else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc){
+			options->output = argv[++i];
+		}
+		else if(strcasecmp(argv[i], "--message") == 0 && i + 1 < argc){
+			options->message = argv[++i];
+		}
+		else if(strcasecmp(argv[i], "--decode") == 0){
+			options->decode = 1;
+		}
+		else if(strcmp(argv[i], "-j") == 0 && i + 1 < argc){
+			long workers;
+
+			if(!parseNumber(argv[++i], 1, QUEUE_MAX_WORKERS, &workers)){
+				printf("Invalid amount of workers %s, it must be between 1 and %d.\n", argv[i], QUEUE_MAX_WORKERS);
+				return 0;
+			}
+			options->workers = (int) workers;
+		}
+		else if(strcasecmp(argv[i], "--memory") == 0 && i + 1 < argc){
+			if((options->memory = parseSize(argv[++i])) == 0){
+				printf("Invalid memory budget %s\n", argv[i]);
+				return 0;
+			}
+		}
+		else if(strcasecmp(argv[i], "--cache") == 0 && i + 1 < argc){
+			options->cacheDirectory = argv[++i];
+		}
+		else if(strcasecmp(argv[i], "--cache-size") == 0 && i + 1 < argc){
+			if((options->cacheLimit = parseSize(argv[++i])) == 0){
+				printf("Invalid cache size %s\n", argv[i]);
+				return 0;
+			}
+		}
+		else if(strcasecmp(argv[i], "--range") == 0 && i + 1 < argc){
+			unsigned long start, length;
+			char end;
+
+			if(sscanf(argv[++i], "%lu:%lu%c", &start, &length, &end) != 2
+				|| start > UINT32_MAX || length > UINT32_MAX){
+				printf("Invalid range %s\n", argv[i]);
+				return 0;
+			}
+			options->ranged = 1;
+			options->rangeStart = (uint32_t) start;
+			options->rangeLength = (uint32_t) length;
+		}
+		else{
+			printf("Unknown option %s\n", argv[i]);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+//The lenght of a row of the data area, needed for finding the
+//blocks used by adaptive embedding.
+uint32_t rowBytes(BMP_FILE* file){
+	return file->width > 0 ? (uint32_t) file->width * 3 : 0;
+}
+
+//Tells the file that only its first used data bytes were changed, so
+//writing it copies the original file and writes only those bytes.
+void markUsed(BMP_FILE* file, unsigned int used){
+	markChanged(file, 0, used < dataSize(file) ? used : dataSize(file));
+}
+
+//The amount of data bytes used by the encodeData()-function, wich
+//leaves a byte unused before the null-character.
+unsigned int legacySize(uint32_t length){
+	return (length + 2) * 8;
+}
+
+//Adds a row of the cover to the hash, called while the data is parsed.
+void hashRow(void* context, const uint8_t* row, unsigned int length){
+	hashUpdate(context, row, length);
+}
+
+//Starts hashing the cover for the result cache. The size and the
+//headers of the file are hashed now, and the rows of the data while
+//they are parsed, so the data does not have to be read again.
+//Must be called after parsing the header. Returns 0 if the headers
+//could not be read.
+int hashCover(BMP_FILE* file, HASH_STATE* hash){
+	uint8_t* headers = malloc(file->offset > 0 ? file->offset : 1);
+	struct stat info;
+	int success = headers != NULL && fstat(fileno(file->fileHandle), &info) == 0
+		&& fseek(file->fileHandle, 0, SEEK_SET) == 0
+		&& fread(headers, 1, file->offset, file->fileHandle) == file->offset;
+
+	if(success){
+		uint64_t size = info.st_size;
+
+		hashInit(hash, 0);
+		hashUpdate(hash, (uint8_t*) &size, sizeof(size));
+		hashUpdate(hash, headers, file->offset);
+		file->rowRead = hashRow;
+		file->rowContext = hash;
+	}
+	free(headers);
+	return success;
+}
+
+//The key of a result in the cache: the hash of the cover continued
+//with the operation, the options of the encoding and the message.
+//The options and the message are NULL for decoding.
+uint64_t resultKey(HASH_STATE* cover, char operation, OPTIONS* options, uint8_t* message, uint32_t length){
+	HASH_STATE hash = *cover;
+	uint8_t parameters[9] = {(uint8_t) operation};
+
+	if(options != NULL){
+		parameters[1] = (uint8_t) options->headered;
+		parameters[2] = options->payload.flags;
+		parameters[3] = options->payload.fecParity;
+		parameters[4] = options->payload.matrixK;
+		for(int i = 0; i < 4; i++)
+			parameters[5 + i] = (uint8_t) (length >> (8 * i));
+	}
+	hashUpdate(&hash, parameters, sizeof(parameters));
+	if(message != NULL)
+		hashUpdate(&hash, message, length);
+	return hashFinal(&hash);
+}
+
+//Stores a decoded message to the cache after its kind and the
+//amount of corrected bytes.
+void storeDecoded(uint64_t key, int kind, uint32_t corrected, uint8_t* message, uint32_t length){
+	uint8_t* packed = malloc((size_t) length + DECODED_PREFIX);
+
+	if(packed == NULL)
+		return;
+
+	packed[0] = (uint8_t) kind;
+	for(int i = 0; i < 4; i++)
+		packed[1 + i] = (uint8_t) (corrected >> (8 * i));
+	memcpy(&packed[DECODED_PREFIX], message, length);
+
+	cacheStore(cache, key, packed, length + DECODED_PREFIX);
+	free(packed);
+}
+
+//The checksum of the data bytes [start, end) of an encoded file,
+//computed while the file is written.
+typedef struct{
+	unsigned int start, end;	//The data bytes checked
+	uint32_t crc;				//The checksum of the bytes written so far
+}WRITE_CHECK;
+
+//Adds the written bytes inside the checked range to the checksum.
+//The bytes are written in order, so the checksum is continued.
+void checkRow(void* context, unsigned int start, const uint8_t* bytes, unsigned int length){
+	WRITE_CHECK* check = context;
+	unsigned int first = start > check->start ? start : check->start,
+				 end = start + length < check->end ? start + length : check->end;
+
+	if(first < end)
+		check->crc = crc32c(check->crc, &bytes[first - start], end - first);
+}
+
+//Checks that the message can be extracted from the encoded data
+//without touching the disk. Messages written without a header are
+//compared up to their lenght, since the encodeData()-function leaves
+//a byte between the message and the null-character.
+//Returns 1 if the message was read back.
+int checkEmbedded(uint8_t* data, unsigned int size, int headered, PAYLOAD_INFO* payload, uint8_t* message, uint32_t length){
+	PAYLOAD_INFO info = *payload;
+	uint8_t* extracted;
+	int same;
+
+	if(!headered){
+		extracted = (uint8_t*) decodeData(data, length + 2);
+		same = extracted != NULL && memcmp(extracted, message, length) == 0;
+	}
+	else{
+		extracted = readPayloadHeader(data, size, &info) ? extractPayload(data, size, &info) : NULL;
+		same = extracted != NULL && info.length == length && memcmp(extracted, message, length) == 0;
+	}
+	free(extracted);
+	return same;
+}
+
+//Flushes the encoded file to the disk and checks that the checked
+//data bytes read back from it have the checksum computed while
+//writing. Only the checked bytes are read. Returns 1 if they match.
+int checkWritten(char* fName, WRITE_CHECK* check){
+	BMP_FILE* written = openBmp(fName);
+	unsigned int length = check->end - check->start;
+	uint8_t* span = malloc(length > 0 ? length : 1);
+	int same = 0;
+
+	if(written != NULL && span != NULL && fsync(fileno(written->fileHandle)) == 0 && parseHeader(written)
+		&& check->end <= dataSize(written) && readDataRange(written, span, check->start, length))
+		same = crc32c(0, span, length) == check->crc;
+
+	free(span);
+	closeBmp(written);
+	return same;
+}
+
+//Opens a BMP_FILE struct from the given filename, parses its
+//header and checks for various error conditions.
+int headerErrors(char* fName, BMP_FILE** fileP){
 	if(!(*fileP = openBmp(fName))){
 		error(*fileP);
 		return 0;
 	}
-	else if(!parseHeader(*fileP)){
+
+	(*fileP)->control = &job;
+	(*fileP)->dropCache = dropPageCache;
+	if(!parseHeader(*fileP)){
 		error(*fileP);
 		return 0;
 	}
-	else if((*fileP)->bpp != 24 || (*fileP)->compression != 0){
+	else if(!((*fileP)->bpp == 24 && (*fileP)->compression == BI_RGB) &&
+		!((*fileP)->bpp == 8 && (*fileP)->compression == BI_RLE8) &&
+		!((*fileP)->bpp == 4 && (*fileP)->compression == BI_RLE4)){
 		(*fileP)->error = NOT_VALID_BITMAP_ERROR;
 		error(*fileP);
 		return 0;
 	}
-	else if(!parseData(*fileP)){
-		error(*fileP);
+	return 1;
+}
+
+//Parses the data of a file opened with the headerErrors()-function.
+//If a hash is given the cover is hashed while it is parsed.
+int dataErrors(BMP_FILE* file, HASH_STATE* hash){
+	if(hash != NULL && !hashCover(file, hash)){
+		file->error = NOT_VALID_BITMAP_ERROR;
+		error(file);
+		return 0;
+	}
+	else if(!parseData(file)){
+		error(file);
 		return 0;
 	}
-
 	return 1;
 }
 
-//Handles the operation for encoding a message to a file.
-void encodeOperation(char* fName){
-	BMP_FILE* file = NULL;
-	
-	if(!bmpErrors(fName, &file))
-		return;
+//Parses a BMP_FILE struct from the given filename and checks 
+//for various error conditions. If a hash is given the cover is
+//hashed while it is parsed.
+int bmpErrors(char* fName, BMP_FILE** fileP, HASH_STATE* hash){
+	return headerErrors(fName, fileP) && dataErrors(*fileP, hash);
+}
 
-	unsigned int maxLenght = dataSize(file) / 8 ;
-	
+//Reads a message of atmost maxLenght - 1 characters from stdin.
+//Returns NULL if there was not enough memory.
+char* readMessage(unsigned int maxLenght){
 	char* buffer = malloc(maxLenght);
 	if(buffer == NULL){
 
 		puts("Not enough memory available for operations.\nTerminating program.");
-		return;
+		return NULL;
 	}
 	
 	printf("Please enter the message to be encoded (max. %u characters)\n", maxLenght);
-	fgets(buffer, maxLenght, stdin);
-
-	if(buffer == NULL){
+	if(fgets(buffer, maxLenght, stdin) == NULL){
 		//Error while reading from stdin
 		puts("There was an error while reading the input.\nTerminating program.\n");
 		exit(EXIT_FAILURE);
 	}
+	return buffer;
+}
+
+//Reads the whole given file to memory. For convenience the contents
+//are followed by an extra null-character. Returns NULL on failure.
+uint8_t* readFile(char* fName, uint32_t* length){
+	FILE* in = fopen(fName, "rb");
+	uint8_t* contents = NULL;
+	long size;
+
+	if(in != NULL && fseek(in, 0, SEEK_END) == 0 && (size = ftell(in)) >= 0
+		&& (uint64_t) size < UINT32_MAX && fseek(in, 0, SEEK_SET) == 0
+		&& (contents = malloc(size + 1)) != NULL){
+
+		contents[size] = '\0';
+		if(fread(contents, 1, size, in) == (size_t) size)
+			*length = (uint32_t) size;
+		else{
+			free(contents);
+			contents = NULL;
+		}
+	}
+	if(in != NULL)
+		fclose(in);
+
+	return contents;
+}
+
+//Builds a container of the entries given with the --add option.
+//Returns NULL on failure.
+uint8_t* buildContainer(OPTIONS* options, uint32_t* length){
+	CONTAINER dir;
+	uint8_t* contents[CONTAINER_MAX_ENTRIES];
+	uint8_t* packed = NULL;
+	int read = 0;
+
+	memset(&dir, 0, sizeof(CONTAINER));
+	dir.count = options->entries;
+
+	for(; read < options->entries; read++){
+		CONTAINER_ENTRY* entry = &dir.entries[read];
+
+		if(strlen(options->entryNames[read]) > CONTAINER_NAME_LENGTH){
+			dir.error = CONTAINER_INVALID_ENTRY;
+			break;
+		}
+		strcpy(entry->name, options->entryNames[read]);
+
+		//The FEC option protects each entry separately.
+		if(options->payload.flags & PAYLOAD_FLAG_FEC){
+			entry->codec = CODEC_FEC;
+			entry->parity = options->payload.fecParity;
+		}
+		if((contents[read] = readFile(options->entryFiles[read], &entry->length)) == NULL){
+			printf("The file %s could not be read.\n", options->entryFiles[read]);
+			break;
+		}
+	}
+
+	if(read == options->entries){
+		packed = packContainer(&dir, contents, length);
+		if(packed == NULL)
+			containerError(&dir);
+	}
+	else
+		containerError(&dir);
+
+	for(int i = 0; i < read; i++)
+		free(contents[i]);
+
+	return packed;
+}
+
+//Encodes the message to a large bitmap. Only the data bytes holding
+//the message are read and changed, then the file is cloned or piped
+//to the encoded file with the changed bytes patched in, so the memory
+//used does not depend on the size of the bitmap.
+//Returns 0 on failure. An error of the file is left to the caller
+//to report, the file is not closed.
+int pipeEncode(BMP_FILE* file, OPTIONS* options, uint8_t* message, uint32_t length){
+	unsigned int size = options->headered ? payloadAreaSize(length, &options->payload) : legacySize(length);
+	uint8_t* window;
+	WRITE_CHECK check;
+
+	if(size > dataSize(file))
+		size = dataSize(file);
+
+	if((window = malloc(size > 0 ? size : 1)) == NULL){
+		file->error = MEMORY_ALLOCATION_ERROR;
+		return 0;
+	}
+	if(!readDataRange(file, window, 0, size)){
+		free(window);
+		return 0;
+	}
+
+	if(!options->headered)
+		encodeData(window, (char*) message);
+
+	else if(!embedPayload(window, dataSize(file), message, length, &options->payload)){
+		payloadError(&options->payload);
+		free(window);
+		return 0;
+	}
+
+	check.start = 0;
+	check.end = size;
+	check.crc = 0;
+	if(options->verify){
+		if(!checkEmbedded(window, dataSize(file), options->headered, &options->payload, message, length)){
+			puts("The message could not be read back from the encoded data, the file was not written.\n");
+			free(window);
+			return 0;
+		}
+		file->rowWritten = checkRow;
+		file->rowContext = &check;
+	}
+
+	int success = pipeFile(file, "encodedBitmap.bmp", window, 0, size);
+	free(window);
+	if(!success)
+		return 0;
+
+	if(options->verify){
+		if(!checkWritten("encodedBitmap.bmp", &check)){
+			puts("The encoded file could not be verified after writing it, it was removed.\n");
+			remove("encodedBitmap.bmp");
+			return 0;
+		}
+		printf("The encoded file was verified (%u data bytes, checksum %08x).\n", check.end - check.start, check.crc);
+	}
+	return 1;
+}
+
+//Handles the operation for encoding a message to a file.
+int encodeOperation(char* fName, OPTIONS* options){
+	BMP_FILE* file = NULL;
+	HASH_STATE hash;
+	uint32_t length;
+	uint64_t key = 0;
+	
+	if(!headerErrors(fName, &file))
+		return 0;
+
+	//Large bitmaps are piped from the original to the encoded file
+	//without reading their data whole. Adaptive embedding needs the
+	//whole image, and looking up the cache needs the hash of the data
+	//before encoding, so they read the data first.
+	int piped = file->bpp == 24 && file->compression == BI_RGB && dataSize(file) >= PIPE_THRESHOLD
+		&& !(options->headered && (options->payload.flags & PAYLOAD_FLAG_ADAPTIVE)) && cache == NULL;
+
+	if(!piped && !dataErrors(file, cache != NULL ? &hash : NULL))
+		return 0;
+
+	char* buffer;
+	options->payload.rowBytes = rowBytes(file);
+	if(options->entries > 0){
+		if(!options->headered){
+			puts("Entries can not be encoded with the --legacy option.\n");
+			closeBmp(file);
+			return 0;
+		}
+		buffer = (char*) buildContainer(options, &length);
+		options->payload.flags = (options->payload.flags & ~PAYLOAD_FLAG_FEC) | PAYLOAD_FLAG_CONTAINER;
+	}
+	else{
+		unsigned int maxLenght = dataSize(file) / 8 ;
+		if(options->headered)
+			maxLenght = payloadCapacity(dataSize(file), &options->payload) + 1;
+
+		buffer = readMessage(maxLenght);
+		if(buffer != NULL)
+			length = strlen(buffer);
+	}
+	if(buffer == NULL){
+		closeBmp(file);
+		return 0;
+	}
+
+	if(piped){
+		int success = pipeEncode(file, options, (uint8_t*) buffer, length);
+		if(success)
+			closeBmp(file);
+		else
+			error(file);
+		free(buffer);
+		return success;
+	}
+
+	//The same cover encoded with the same message and options
+	//before is copied from the cache.
+	if(cache != NULL){
+		key = resultKey(&hash, 'e', options, (uint8_t*) buffer, length);
+		if(!options->verify && cacheFetch(cache, key, "encodedBitmap.bmp")){
+			closeBmp(file);
+			free(buffer);
+			return 1;
+		}
+	}
+
+	if(!options->headered){
+		encodeData(file->data, buffer);
+		markUsed(file, legacySize(length));
+	}
+	else if(!embedPayload(file->data, dataSize(file), (uint8_t*) buffer, length, &options->payload)){
+		payloadError(&options->payload);
+		closeBmp(file);
+		free(buffer);
+		return 0;
+	}
+	else
+		markUsed(file, payloadAreaSize(length, &options->payload));
+
+	//The message is read back from the data before writing it, and
+	//the checksum of the written bytes is computed while writing.
+	WRITE_CHECK check = {0, file->changedEnd, 0};
+	if(options->verify){
+		if(!checkEmbedded(file->data, dataSize(file), options->headered, &options->payload, (uint8_t*) buffer, length)){
+			puts("The message could not be read back from the encoded data, the file was not written.\n");
+			closeBmp(file);
+			free(buffer);
+			return 0;
+		}
+		file->rowWritten = checkRow;
+		file->rowContext = &check;
+	}
 
-	encodeData(file->data, buffer);
 	if(!writeToFile(file, "encodedBitmap.bmp")){
 		error(file);
-		return;
+		free(buffer);
+		return 0;
+	}
+	if(options->verify){
+		if(!checkWritten("encodedBitmap.bmp", &check)){
+			puts("The encoded file could not be verified after writing it, it was removed.\n");
+			remove("encodedBitmap.bmp");
+			closeBmp(file);
+			free(buffer);
+			return 0;
+		}
+		printf("The encoded file was verified (%u data bytes, checksum %08x).\n", check.end - check.start, check.crc);
 	}
+	if(cache != NULL)
+		cacheStoreFile(cache, key, "encodedBitmap.bmp");
 
 	closeBmp(file);
 	free(buffer);
+	return 1;
 }
 
-//Handles the operation for decoding a message.
-void decodeOperation(char* fName){
+//Handles the operations for appending to or replacing the message
+//in a file encoded with a header. The file is modified in place and
+//only the data bytes holding the changed part of the message are
+//read and written.
+void appendOperation(char* fName, int replace){
 	BMP_FILE* file = NULL;
-	char* message = NULL;
-	
-	if(!bmpErrors(fName, &file))
+	PAYLOAD_INFO info;
+	uint8_t headerArea[HEADER_AREA];
+
+	if(!headerErrors(fName, &file))
 		return;
 
-	message = decodeData(file->data, dataSize(file));
+	//The message is changed straight in the file, wich works only
+	//for uncompressed bitmaps.
+	if(file->bpp != 24 || file->compression != BI_RGB){
+		file->error = NOT_VALID_BITMAP_ERROR;
+		error(file);
+		return;
+	}
+	if(!readDataRange(file, headerArea, 0, HEADER_AREA)){
+		error(file);
+		return;
+	}
+	info.rowBytes = rowBytes(file);
+	if(!readPayloadHeader(headerArea, dataSize(file), &info)){
+		payloadError(&info);
+		closeBmp(file);
+		return;
+	}
+	if(!replace && (info.flags & PAYLOAD_FLAG_ADAPTIVE)){
+		info.error = PAYLOAD_NOT_APPENDABLE;
+		payloadError(&info);
+		closeBmp(file);
+		return;
+	}
 
-	if(message == NULL){
+	//The new message is plain text, the entries of a container are
+	//replaced with it. The rest of the flags tell how the message is
+	//embedded, so they are kept.
+	if(replace)
+		info.flags &= ~PAYLOAD_FLAG_CONTAINER;
+
+	unsigned int maxLenght = payloadCapacity(dataSize(file), &info) + 1;
+	if(!replace)
+		maxLenght -= info.length;
+
+	char* buffer = readMessage(maxLenght);
+	if(buffer == NULL){
+		closeBmp(file);
+		return;
+	}
+	uint32_t length = strlen(buffer);
+
+	//For replacing the header is rewritten together with the message,
+	//for appending the new bytes are written before the header so the
+	//old message stays valid until the header is updated.
+	uint32_t start = 0, end;
+	if(replace){
+		end = payloadAreaSize(length, &info);
+		if(end > dataSize(file))
+			end = dataSize(file);
+	}
+	else
+		payloadSpan(&info, info.length, length, &start, &end);
+
+	uint8_t* window = malloc(end - start + 1);
+	if(window == NULL){
 		file->error = MEMORY_ALLOCATION_ERROR;
 		error(file);
+		free(buffer);
 		return;
 	}
 
-	printf("Message decoded from file %s:\n", fName);
-	printf("%s\n", message);
-	
+	//error() closes the file, after it has been called the
+	//file pointer is set to NULL.
+	int success = readDataRange(file, window, start, end - start);
+	if(!success){
+		error(file);
+		file = NULL;
+	}
+	else if(replace)
+		success = embedPayload(window, dataSize(file), (uint8_t*) buffer, length, &info);
+	else
+		success = appendPayload(window, start, dataSize(file), (uint8_t*) buffer, length, &info);
+
+	if(file != NULL && !success){
+		payloadError(&info);
+	}
+	else if(file != NULL && !writeDataRange(file, window, start, end - start)){
+		error(file);
+		file = NULL;
+	}
+	else if(file != NULL && !replace){
+		writePayloadHeader(headerArea, &info);
+		if(!writeDataRange(file, headerArea, 0, HEADER_AREA)){
+			error(file);
+			file = NULL;
+		}
+	}
+
+	if(file != NULL && success)
+		printf("The message in %s is now %u bytes long.\n", fName, info.length);
+
 	closeBmp(file);
-	free(message);
+	free(window);
+	free(buffer);
 }
 
-int main(int argc, char** argv){
+//Reads the payload header of a file. If the data of the file is not
+//loaded only the data bytes holding the header are read from the file.
+//Returns 0 on failure, if the failure was not caused by the file the
+//error variable of the file is NO_ERROR.
+int loadHeader(BMP_FILE* file, PAYLOAD_INFO* info){
+	uint8_t headerArea[HEADER_AREA];
+	uint8_t* area = file->data;
 
-	switch (argc){
+	info->error = PAYLOAD_OK;
+	info->rowBytes = rowBytes(file);
+	if(area == NULL){
+		if(!readDataRange(file, headerArea, 0, HEADER_AREA))
+			return 0;
+		area = headerArea;
+	}
 
-		case 1:
-		case 2: help();
-			break;
+	file->error = NO_ERROR;
+	return readPayloadHeader(area, dataSize(file), info);
+}
 
-		case 3:
-			if(strncasecmp(argv[1], "-e" , 2) == 0)
-				encodeOperation(argv[2]);
+//Extracts the message of a file encoded with a header. Only the data
+//bytes holding the header and the message are read from the file.
+//Returns NULL on failure, if the failure was not caused by the file
+//the error variable of the file is NO_ERROR.
+uint8_t* loadPayload(BMP_FILE* file, PAYLOAD_INFO* info){
+	if(!loadHeader(file, info))
+		return NULL;
 
+	unsigned int size = payloadAreaSize(info->length, info);
+	if(size > dataSize(file))
+		size = dataSize(file);
 
-			if(strncasecmp(argv[1], "-d", 2) == 0)
-				decodeOperation(argv[2]);
+	uint8_t* window = malloc(size);
+	if(window == NULL){
+		info->error = PAYLOAD_MEMORY_ERROR;
+		return NULL;
+	}
+	if(!readDataRange(file, window, 0, size)){
+		free(window);
+		return NULL;
+	}
 
-			break;
+	uint8_t* payload = extractPayload(window, dataSize(file), info);
+	free(window);
+	return payload;
+}
+
+//Reads data bytes of the given file for the extractRange()-function.
+int fileReader(void* handle, uint8_t* buffer, uint32_t start, uint32_t length){
+	return readDataRange((BMP_FILE*) handle, buffer, start, length);
+}
+
+//Extracts the payload bytes [first, first + count) of a file. If the
+//data of the file is loaded the bytes are extracted from it, otherwise
+//only the data bytes holding them are read from the file.
+//Returns NULL on failure, if the failure was not caused by the file
+//the error variable of the file is NO_ERROR.
+uint8_t* loadRange(BMP_FILE* file, PAYLOAD_INFO* info, uint32_t first, uint32_t count){
+	PAYLOAD_SOURCE source = {file->data, fileReader, file};
+	uint8_t* bytes = malloc(count > 0 ? count : 1);
 
-		default: help();
+	if(bytes == NULL){
+		info->error = PAYLOAD_MEMORY_ERROR;
+		return NULL;
 	}
+
+	file->error = NO_ERROR;
+	if(!extractRange(&source, bytes, first, count, info)){
+		free(bytes);
+		if(info->error != PAYLOAD_NOT_SEEKABLE)
+			return NULL;
+
+		//The blocks used by adaptive embedding are found by going
+		//through the image, so the whole payload is extracted.
+		uint8_t* payload = file->data != NULL ? extractPayload(file->data, dataSize(file), info) : loadPayload(file, info);
+		if(payload == NULL)
+			return NULL;
+
+		memmove(payload, &payload[first], count);
+		return payload;
+	}
+	return bytes;
+}
+
+//Reads the directory of a file holding entries. Prints an error
+//message and returns 0 on failure.
+int loadDirectory(BMP_FILE* file, PAYLOAD_INFO* info, CONTAINER* dir){
+	uint8_t* bytes = loadRange(file, info, 0, CONTAINER_DIRECTORY_START);
+	uint32_t size = 0;
+
+	//The amount of entries tells the size of the directory.
+	if(bytes != NULL){
+		uint32_t count = toUInt(bytes);
+		free(bytes);
+
+		size = directorySize(count < CONTAINER_MAX_ENTRIES ? count : CONTAINER_MAX_ENTRIES);
+		bytes = loadRange(file, info, 0, size);
+	}
+	if(bytes == NULL){
+		if(file->error != NO_ERROR)
+			error(file);
+		else
+			payloadError(info);
+		return 0;
+	}
+
+	int success = readDirectory(bytes, size, dir);
+	if(!success)
+		containerError(dir);
+
+	free(bytes);
+	return success;
+}
+
+//Prints the entries of a file holding entries.
+void listOperation(BMP_FILE* file, PAYLOAD_INFO* info, char* fName){
+	CONTAINER dir;
+
+	if(!loadDirectory(file, info, &dir))
+		return;
+
+	printf("The file %s holds %u entries:\n", fName, dir.count);
+	for(uint32_t i = 0; i < dir.count; i++){
+		CONTAINER_ENTRY* entry = &dir.entries[i];
+
+		printf("%-16s %10u bytes", entry->name, entry->length);
+		if(entry->codec == CODEC_FEC)
+			printf(" (error correction, %u parity bytes)", entry->parity);
+		printf("\n");
+	}
+}
+
+//Handles the operation for decoding a single entry. Only the data
+//bytes holding the header, the directory and the entry are read
+//from the file, and the entry is written as is to the standard output.
+void entryOperation(char* fName, char* name){
+	BMP_FILE* file = openBmp(fName);
+	PAYLOAD_INFO info;
+	CONTAINER dir;
+
+	if(file != NULL)
+		file->dropCache = dropPageCache;
+	if(file == NULL || !parseHeader(file)){
+		error(file);
+		return;
+	}
+	if(!loadHeader(file, &info)){
+		if(file->error != NO_ERROR)
+			error(file);
+		else{
+			payloadError(&info);
+			closeBmp(file);
+		}
+		return;
+	}
+	if(!(info.flags & PAYLOAD_FLAG_CONTAINER)){
+		printf("The file %s does not hold entries.\n", fName);
+		closeBmp(file);
+		return;
+	}
+	if(!loadDirectory(file, &info, &dir)){
+		if(file->error == NO_ERROR)
+			closeBmp(file);
+		return;
+	}
+
+	CONTAINER_ENTRY* entry = findEntry(&dir, name);
+	if(entry == NULL){
+		printf("The file %s has no entry called %s.\n", fName, name);
+		closeBmp(file);
+		return;
+	}
+
+	uint8_t* stored = loadRange(file, &info, directorySize(dir.count) + entry->offset, entry->storedLength);
+	if(stored == NULL){
+		if(file->error != NO_ERROR){
+			error(file);
+			return;
+		}
+		payloadError(&info);
+		closeBmp(file);
+		return;
+	}
+
+	uint8_t* contents = unpackEntry(stored, entry, &dir);
+	if(contents == NULL)
+		containerError(&dir);
+	else
+		fwrite(contents, 1, entry->length, stdout);
+
+	free(stored);
+	free(contents);
+	closeBmp(file);
+}
+
+//Prints the memory reserved from the budget at the moment and at most.
+void printMemory(FILE* out, MEMORY_BUDGET* budget){
+	uint64_t reserved, peak;
+
+	budgetStats(budget, &reserved, &peak);
+	fprintf(out, "Memory: %llu bytes reserved, peak %llu bytes", (unsigned long long) reserved,
+		(unsigned long long) peak);
+	if(budget->limit > 0)
+		fprintf(out, " of %llu bytes", (unsigned long long) budget->limit);
+	fprintf(out, "\n");
+	fflush(out);
+}
+
+//The state shared by the workers of the -v operation.
+typedef struct{
+	char** fNames;				//The files to be checked
+	char** results;				//The line printed for each file, NULL until it is checked
+	int count;					//The amount of files
+	int printed;				//The amount of lines printed so far
+	int failed;					//The amount of files that did not pass the check
+	MEMORY_BUDGET budget;		//The memory shared by the workers
+	pthread_mutex_t lock;		//Protects the results
+}VERIFY_BATCH;
+
+//Checks the message of a single file and describes the result in the
+//given line. Only the data bytes holding the header and the message
+//are read, and the memory needed for them is reserved from the budget
+//once the header has been read. Returns 1 if the file passed the check.
+int verifyFile(VERIFY_BATCH* batch, char* fName, char* line, size_t size){
+	BMP_FILE* file = openBmp(fName);
+	PAYLOAD_INFO info;
+	uint8_t* payload = NULL;
+	uint64_t needed = 0;
+
+	if(file == NULL){
+		snprintf(line, size, "%s: FAILED (the file could not be opened)\n", fName);
+		return 0;
+	}
+	file->dropCache = dropPageCache;
+	if(parseHeader(file) && loadHeader(file, &info)){
+		uint64_t used = payloadAreaSize(info.length, &info);
+		needed = (used < dataSize(file) ? used : dataSize(file)) + info.storedLength + info.length + 2;
+
+		if(!budgetReserve(&batch->budget, needed)){
+			snprintf(line, size, "%s: FAILED (too large for the memory budget)\n", fName);
+			closeBmp(file);
+			return 0;
+		}
+		payload = loadPayload(file, &info);
+		budgetRelease(&batch->budget, needed);
+	}
+
+	if(payload != NULL)
+		snprintf(line, size, "%s: OK (%u bytes, checksum %08x)\n", fName, info.length, info.checksum);
+
+	else if(file->error != NO_ERROR)
+		snprintf(line, size, "%s: FAILED (not a valid bitmap)\n", fName);
+
+	else if(info.error == PAYLOAD_NO_HEADER)
+		snprintf(line, size, "%s: FAILED (no header)\n", fName);
+
+	else if(info.error == PAYLOAD_CHECKSUM_ERROR)
+		snprintf(line, size, "%s: FAILED (checksum mismatch)\n", fName);
+
+	else if(info.error == PAYLOAD_UNCORRECTABLE)
+		snprintf(line, size, "%s: FAILED (too damaged to be corrected)\n", fName);
+
+	else
+		snprintf(line, size, "%s: FAILED (out of memory)\n", fName);
+
+	free(payload);
+	closeBmp(file);
+	return payload != NULL;
+}
+
+//Checks a file of the -v operation, called from the worker threads.
+//The lines are printed in the order the files were given.
+void verifyWork(void* context, void* item){
+	VERIFY_BATCH* batch = context;
+	char** fName = item;
+	int index = (int) (fName - batch->fNames);
+	size_t size = strlen(*fName) + 96;
+	char* line = malloc(size);
+	int passed = 0;
+
+	if(line != NULL)
+		passed = verifyFile(batch, *fName, line, size);
+
+	pthread_mutex_lock(&batch->lock);
+	if(!passed)
+		batch->failed++;
+	batch->results[index] = line != NULL ? line : "";
+	while(batch->printed < batch->count && batch->results[batch->printed] != NULL){
+		fputs(batch->results[batch->printed], stdout);
+		batch->printed++;
+	}
+	fflush(stdout);
+	pthread_mutex_unlock(&batch->lock);
+}
+
+//Checks the messages of the given files. Prints a line for each
+//file and returns the amount of files that did not pass the check.
+//The options -j, --memory and --no-page-cache may be given before the files.
+int verifyOperation(int count, char** fNames){
+	VERIFY_BATCH batch;
+	uint64_t memory = 0;
+	int workers = 1;
+
+	while(count >= 1){
+		if(strcasecmp(fNames[0], "--no-page-cache") == 0){
+			dropPageCache = 1;
+			count--;
+			fNames++;
+			continue;
+		}
+		if(count < 2 || (strcmp(fNames[0], "-j") != 0 && strcasecmp(fNames[0], "--memory") != 0))
+			break;
+
+		long number;
+
+		if(fNames[0][1] == 'j'){
+			if(!parseNumber(fNames[1], 1, QUEUE_MAX_WORKERS, &number)){
+				printf("Invalid amount of workers %s, it must be between 1 and %d.\n", fNames[1], QUEUE_MAX_WORKERS);
+				return count;
+			}
+			workers = (int) number;
+		}
+		else if((memory = parseSize(fNames[1])) == 0){
+			printf("Invalid memory budget %s\n", fNames[1]);
+			return count;
+		}
+		count -= 2;
+		fNames += 2;
+	}
+
+	memset(&batch, 0, sizeof(VERIFY_BATCH));
+	batch.fNames = fNames;
+	batch.count = count;
+	batch.results = calloc(count > 0 ? count : 1, sizeof(char*));
+	budgetInit(&batch.budget, memory);
+	pthread_mutex_init(&batch.lock, NULL);
+
+	WORK_QUEUE* queue = batch.results != NULL ? createQueue(workers, verifyWork, &batch) : NULL;
+	if(queue == NULL){
+		puts("Not enough memory available for operations.\nTerminating program.");
+		free(batch.results);
+		return count;
+	}
+
+	//A file that could not be queued is checked here.
+	for(int i = 0; i < count; i++)
+		if(!pushWork(queue, &fNames[i]))
+			verifyWork(&batch, &fNames[i]);
+	destroyQueue(queue);
+
+	if(memory > 0)
+		printMemory(stderr, &batch.budget);
+
+	for(int i = 0; i < count; i++)
+		if(batch.results[i][0] != '\0')
+			free(batch.results[i]);
+	free(batch.results);
+	budgetDestroy(&batch.budget);
+	pthread_mutex_destroy(&batch.lock);
+	return batch.failed;
+}
+
+//Screens the given files for messages hidden by any program. Prints
+//a line for each file and returns the amount of files that could not
+//be analysed.
+int screenOperation(int count, char** fNames){
+	int failed = 0;
+	uint8_t* buffer = malloc(STREAM_CHUNK);
+	LSB_ANALYSIS* state = malloc(sizeof(LSB_ANALYSIS));
+
+	if(buffer == NULL || state == NULL){
+		puts("Not enough memory available for operations.\nTerminating program.");
+		free(buffer);
+		free(state);
+		return count;
+	}
+
+	for(int i = 0; i < count; i++){
+		BMP_FILE* file = openBmp(fNames[i]);
+		LSB_REPORT report;
+
+		if(file == NULL || !parseHeader(file)){
+			printf("%s: FAILED (not a valid bitmap)\n", fNames[i]);
+			closeBmp(file);
+			failed++;
+			continue;
+		}
+
+		//The data is streamed through the analysis in chunks
+		//so the whole image is never in memory.
+		unsigned int size = dataSize(file), position = 0;
+		analysisInit(state, size);
+		while(position < size){
+			unsigned int amount = size - position < STREAM_CHUNK ? size - position : STREAM_CHUNK;
+			if(!readDataRange(file, buffer, position, amount))
+				break;
+			analysisUpdate(state, buffer, amount);
+			position += amount;
+		}
+
+		if(position < size){
+			printf("%s: FAILED (not a valid or supported bitmap)\n", fNames[i]);
+			failed++;
+		}
+		else{
+			analysisFinish(state, &report);
+			printf("%s: score %.3f (chi-square %.3f over %.0f%% of the data, sample pairs %.3f)\n",
+				fNames[i], report.score, report.chiProbability, report.chiExtent * 100, report.pairEstimate);
+		}
+		closeBmp(file);
+	}
+	free(buffer);
+	free(state);
+	return failed;
+}
+
+//Prints a file name as a JSON string.
+void printJsonString(const char* text){
+	putchar('"');
+	for(; *text; text++){
+		unsigned char c = *text;
+		if(c == '"' || c == '\\')
+			printf("\\%c", c);
+		else if(c < 0x20)
+			printf("\\u%04x", c);
+		else
+			putchar(c);
+	}
+	putchar('"');
+}
+
+//Prints the header values and the capacities of a single file as
+//a JSON line. Returns 1 if the file could be probed.
+int infoLine(char* fName){
+	BMP_INFO info;
+
+	printf("{\"file\":");
+	printJsonString(fName);
+
+	if(!probeBmp(fName, &info)){
+		printf(",\"error\":\"%s\"}\n", info.error == NULL_FILE_ERROR ? "can not open" : "not a bitmap");
+		return 0;
+	}
+
+	printf(",\"width\":%d,\"height\":%d,\"bpp\":%d,\"compression\":%u,\"rowStride\":%u,\"dataSize\":%u,\"supported\":%s",
+		info.width, info.height, info.bpp, info.compression, info.rowStride, info.dataSize,
+		info.supported ? "true" : "false");
+
+	if(info.supported){
+		PAYLOAD_INFO options = {0};
+
+		//The legacy format stores the terminating null-character.
+		printf(",\"capacity\":{\"legacy\":%u", info.dataSize / 8 > 0 ? info.dataSize / 8 - 1 : 0);
+		printf(",\"lsb\":%u", payloadCapacity(info.dataSize, &options));
+
+		options.flags = PAYLOAD_FLAG_FEC;
+		options.fecParity = DEFAULT_FEC_PARITY;
+		printf(",\"fec\":%u", payloadCapacity(info.dataSize, &options));
+
+		options.flags = PAYLOAD_FLAG_MATRIX;
+		for(int k = MATRIX_MIN_K; k <= MATRIX_MAX_K; k++){
+			options.matrixK = k;
+			printf(",\"matrix%d\":%u", k, payloadCapacity(info.dataSize, &options));
+		}
+
+		options.flags = PAYLOAD_FLAG_ADAPTIVE;
+		options.rowBytes = info.width > 0 ? (uint32_t) info.width * 3 : 0;
+		printf(",\"adaptive\":%u", payloadCapacity(info.dataSize, &options));
+		putchar('}');
+	}
+	printf("}\n");
+	return 1;
+}
+
+//Prints a JSON line describing each of the given files. If the only
+//file name given is "-", the file names are read from the standard
+//input, one per line. Returns the amount of files that could not be
+//probed.
+int infoOperation(int count, char** fNames){
+	static char output[1 << 16];
+	int failed = 0;
+
+	//Nothing is printed to the user in between, so the output
+	//can be written in large blocks.
+	setvbuf(stdout, output, _IOFBF, sizeof(output));
+
+	if(count == 1 && strcmp(fNames[0], "-") == 0){
+		char line[4096];
+
+		while(fgets(line, sizeof(line), stdin) != NULL){
+			line[strcspn(line, "\r\n")] = '\0';
+			if(line[0] != '\0')
+				failed += !infoLine(line);
+		}
+	}
+	else
+		for(int i = 0; i < count; i++)
+			failed += !infoLine(fNames[i]);
+
+	fflush(stdout);
+	return failed;
+}
+
+//Handles the operation for decoding a range of a message. Only the
+//data bytes holding the header and the range are read from the file,
+//and the range is written as is to the standard output.
+void rangeOperation(char* fName, uint32_t start, uint32_t length){
+	BMP_FILE* file = openBmp(fName);
+	PAYLOAD_INFO info;
+
+	if(file != NULL)
+		file->dropCache = dropPageCache;
+	if(file == NULL || !parseHeader(file)){
+		error(file);
+		return;
+	}
+
+	//Files without a header are assumed to be encoded with the
+	//encodeData()-function.
+	if(!loadHeader(file, &info)){
+		if(file->error != NO_ERROR){
+			error(file);
+			return;
+		}
+		memset(&info, 0, sizeof(PAYLOAD_INFO));
+		info.flags = PAYLOAD_FLAG_LEGACY;
+		info.length = dataSize(file) / 8;
+	}
+
+	uint8_t* bytes = loadRange(file, &info, start, length);
+	if(bytes == NULL){
+		if(file->error != NO_ERROR){
+			error(file);
+			return;
+		}
+		payloadError(&info);
+		closeBmp(file);
+		return;
+	}
+
+	//The message of a file without a header ends to a null-character.
+	uint8_t* terminator;
+	if((info.flags & PAYLOAD_FLAG_LEGACY) && (terminator = memchr(bytes, '\0', length)) != NULL)
+		length = terminator - bytes;
+
+	fwrite(bytes, 1, length, stdout);
+	if(info.corrected > 0)
+		fprintf(stderr, "(%u damaged bytes were corrected)\n", info.corrected);
+
+	free(bytes);
+	closeBmp(file);
+}
+
+//Prints a message decoded from the given file.
+void printDecoded(char* fName, int kind, uint32_t corrected, char* message, uint32_t length){
+	if(kind == DECODED_LEGACY){
+		puts("The file has no header, the integrity of the message can not be checked.");
+		printf("Message decoded from file %s:\n", fName);
+	}
+	else
+		printf("Message decoded from file %s (checksum OK):\n", fName);
+
+	fwrite(message, 1, length, stdout);
+	printf("\n");
+	if(corrected > 0)
+		printf("(%u damaged bytes were corrected)\n", corrected);
+}
+
+//Handles the operation for decoding a message.
+void decodeOperation(char* fName, OPTIONS* options){
+	BMP_FILE* file = NULL;
+	char* message = NULL;
+	PAYLOAD_INFO info;
+	HASH_STATE hash;
+	uint64_t key = 0;
+
+	if(options->entry != NULL){
+		entryOperation(fName, options->entry);
+		return;
+	}
+	if(options->ranged){
+		rangeOperation(fName, options->rangeStart, options->rangeLength);
+		return;
+	}
+	
+	if(!bmpErrors(fName, &file, cache != NULL ? &hash : NULL))
+		return;
+
+	//A message decoded from the same cover before is read from the cache.
+	if(cache != NULL){
+		uint8_t* cached;
+		uint32_t length;
+
+		key = resultKey(&hash, 'd', NULL, NULL, 0);
+		if((cached = cacheLoad(cache, key, &length)) != NULL && length >= DECODED_PREFIX){
+			printDecoded(fName, cached[0], cached[1] | cached[2] << 8 | cached[3] << 16 | (uint32_t) cached[4] << 24,
+				(char*) &cached[DECODED_PREFIX], length - DECODED_PREFIX);
+			closeBmp(file);
+			free(cached);
+			return;
+		}
+		free(cached);
+	}
+
+	//Files with a header are decoded according to it, the rest
+	//are assumed to be encoded with the encodeData()-function.
+	info.rowBytes = rowBytes(file);
+	int headered = readPayloadHeader(file->data, dataSize(file), &info);
+
+	if(headered && (info.flags & PAYLOAD_FLAG_CONTAINER)){
+		listOperation(file, &info, fName);
+		closeBmp(file);
+		return;
+	}
+	if(headered){
+		message = (char*) extractPayload(file->data, dataSize(file), &info);
+		if(message == NULL){
+			payloadError(&info);
+			closeBmp(file);
+			return;
+		}
+
+		printDecoded(fName, DECODED_CHECKED, info.corrected, message, info.length);
+		if(cache != NULL)
+			storeDecoded(key, DECODED_CHECKED, info.corrected, (uint8_t*) message, info.length);
+
+		closeBmp(file);
+		free(message);
+		return;
+	}
+
+	message = decodeData(file->data, dataSize(file));
+
+	if(message == NULL){
+		puts("The file has no header, the integrity of the message can not be checked.");
+		file->error = MEMORY_ALLOCATION_ERROR;
+		error(file);
+		return;
+	}
+
+	printDecoded(fName, DECODED_LEGACY, 0, message, strlen(message));
+	if(cache != NULL)
+		storeDecoded(key, DECODED_LEGACY, 0, (uint8_t*) message, strlen(message));
+	
+	closeBmp(file);
+	free(message);
+}
+
+//The settings shared by the workers of the watch mode.
+typedef struct{
+	OPTIONS* options;			//The options given to the program
+	uint8_t* message;			//The message or the entries to be encoded
+	uint32_t length;			//The lenght of the message
+	char* output;				//The output directory
+	FOLDER_WATCH* watch;		//The watch reporting the files
+	MEMORY_BUDGET budget;		//The memory shared by the workers
+	uint64_t share;				//The budget divided by the workers, 0 for no budget
+}WATCH_SETTINGS;
+
+//Is set to 1 when the watch mode should stop.
+volatile sig_atomic_t stopWatch = 0;
+
+//The monotonic time in seconds.
+double monotonicTime(){
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+//Decodes a message written with the encodeData()-function, reading the
+//file a chunk at a time. Returns NULL on failure.
+uint8_t* streamLegacy(BMP_FILE* file, uint32_t* length){
+	unsigned int size = dataSize(file) / 8 * 8, position = 0;
+	uint8_t* chunk = malloc(STREAM_CHUNK);
+	uint8_t* message = malloc(size / 8 + 1);
+
+	if(chunk == NULL || message == NULL){
+		free(chunk);
+		free(message);
+		return NULL;
+	}
+
+	*length = 0;
+	while(position < size){
+		unsigned int amount = size - position < STREAM_CHUNK ? size - position : STREAM_CHUNK;
+		if(!readDataRange(file, chunk, position, amount)){
+			free(chunk);
+			free(message);
+			return NULL;
+		}
+		for(unsigned int i = 0; i < amount; i += 8){
+			if((message[*length] = decode(&chunk[i])) == '\0'){
+				free(chunk);
+				return message;
+			}
+			(*length)++;
+		}
+		position += amount;
+	}
+	message[*length] = '\0';
+	free(chunk);
+	return message;
+}
+
+//Writes the decoded message to the given file. Returns a description
+//of the failure, or NULL on success.
+const char* writeMessage(char* fName, uint8_t* message, uint32_t length){
+	FILE* out;
+
+	if(message == NULL)
+		return "the message could not be decoded";
+	if((out = fopen(fName, "wb")) == NULL)
+		return "the output could not be written";
+	if(fwrite(message, 1, length, out) != length){
+		fclose(out);
+		return "the output could not be written";
+	}
+	if(fclose(out) != 0)
+		return "the output could not be written";
+	return NULL;
+}
+
+//Handles a file of the watch mode by parsing its data whole.
+//The result of the file is looked up from the cache, if the cache is used.
+const char* processWhole(WATCH_SETTINGS* settings, BMP_FILE* file, PAYLOAD_INFO* info, char* temporary){
+	const char* failure = NULL;
+	int decoding = settings->options->decode;
+	HASH_STATE hash;
+	uint64_t key = 0;
+
+	if(cache != NULL && !hashCover(file, &hash))
+		return "not a valid or supported bitmap";
+
+	if(!parseData(file))
+		return file->error == JOB_DEADLINE_ERROR ? "the time ran out" : "not a valid or supported bitmap";
+
+	if(cache != NULL){
+		key = decoding ? resultKey(&hash, 'd', NULL, NULL, 0)
+			: resultKey(&hash, 'e', settings->options, settings->message, settings->length);
+
+		if(!decoding && !settings->options->verify && cacheFetch(cache, key, temporary))
+			return NULL;
+
+		uint32_t length;
+		uint8_t* cached = decoding ? cacheLoad(cache, key, &length) : NULL;
+		if(cached != NULL && length >= DECODED_PREFIX){
+			failure = writeMessage(temporary, &cached[DECODED_PREFIX], length - DECODED_PREFIX);
+			free(cached);
+			return failure;
+		}
+		free(cached);
+	}
+
+	if(decoding){
+		uint8_t* message;
+		uint32_t length;
+		int kind = DECODED_LEGACY;
+
+		if(readPayloadHeader(file->data, dataSize(file), info)){
+			message = extractPayload(file->data, dataSize(file), info);
+			length = info->length;
+			kind = DECODED_CHECKED;
+		}
+		else{
+			message = (uint8_t*) decodeData(file->data, dataSize(file) / 8);
+			length = message != NULL ? (uint32_t) (memchr(message, '\0', dataSize(file) / 8) != NULL ?
+				strlen((char*) message) : dataSize(file) / 8) : 0;
+		}
+		failure = writeMessage(temporary, message, length);
+
+		//The entries of a container are not decoded, so the
+		//container is not stored with the other messages.
+		if(failure == NULL && cache != NULL && !(kind != DECODED_LEGACY && (info->flags & PAYLOAD_FLAG_CONTAINER)))
+			storeDecoded(key, kind, kind == DECODED_LEGACY ? 0 : info->corrected, message, length);
+		free(message);
+		return failure;
+	}
+
+	if(!settings->options->headered){
+		if(settings->length >= dataSize(file) / 8)
+			return "the message is too long";
+
+		encodeData(file->data, (char*) settings->message);
+		markUsed(file, legacySize(settings->length));
+	}
+	else if(!embedPayload(file->data, dataSize(file), settings->message, settings->length, info))
+		return info->error == PAYLOAD_TOO_LARGE ? "the message is too long" : "the message could not be encoded";
+	else
+		markUsed(file, payloadAreaSize(settings->length, info));
+
+	WRITE_CHECK check = {0, file->changedEnd, 0};
+	if(settings->options->verify){
+		if(!checkEmbedded(file->data, dataSize(file), settings->options->headered, info, settings->message, settings->length))
+			return "the message could not be read back";
+		file->rowWritten = checkRow;
+		file->rowContext = &check;
+	}
+
+	if(!writeToFile(file, temporary))
+		return file->error == JOB_DEADLINE_ERROR ? "the time ran out" : "the output could not be written";
+	if(settings->options->verify && !checkWritten(temporary, &check))
+		return "the written file could not be verified";
+	if(cache != NULL)
+		cacheStoreFile(cache, key, temporary);
+	return NULL;
+}
+
+//Handles a file of the watch mode reading only the data bytes holding
+//the message, so the memory needed does not depend on the size of the
+//image.
+const char* processStreamed(WATCH_SETTINGS* settings, BMP_FILE* file, PAYLOAD_INFO* info, char* temporary){
+	const char* failure = NULL;
+
+	if(settings->options->decode){
+		uint8_t* message;
+		uint32_t length;
+
+		if(loadHeader(file, info)){
+			message = loadPayload(file, info);
+			length = info->length;
+		}
+		else
+			message = streamLegacy(file, &length);
+
+		failure = writeMessage(temporary, message, length);
+		free(message);
+		return failure;
+	}
+
+	unsigned int size = settings->options->headered ? payloadAreaSize(settings->length, info)
+		: legacySize(settings->length);
+	if(!settings->options->headered && settings->length >= dataSize(file) / 8)
+		return "the message is too long";
+	if(size > dataSize(file))
+		size = dataSize(file);
+
+	uint8_t* window = malloc(size);
+	if(window == NULL)
+		return "not enough memory";
+
+	if(!readDataRange(file, window, 0, size))
+		failure = "not a valid or supported bitmap";
+
+	else if(!settings->options->headered)
+		encodeData(window, (char*) settings->message);
+
+	else if(!embedPayload(window, dataSize(file), settings->message, settings->length, info))
+		failure = info->error == PAYLOAD_TOO_LARGE ? "the message is too long" : "the message could not be encoded";
+
+	WRITE_CHECK check = {0, size, 0};
+	if(failure == NULL && settings->options->verify){
+		if(!checkEmbedded(window, dataSize(file), settings->options->headered, info, settings->message, settings->length))
+			failure = "the message could not be read back";
+		file->rowWritten = checkRow;
+		file->rowContext = &check;
+	}
+
+	if(failure == NULL && !writeRangeToFile(file, temporary, window, 0, size))
+		failure = file->error == JOB_DEADLINE_ERROR ? "the time ran out" : "the output could not be written";
+
+	if(failure == NULL && settings->options->verify && !checkWritten(temporary, &check))
+		failure = "the written file could not be verified";
+
+	free(window);
+	return failure;
+}
+
+//Estimates from the headers of the file how much memory handling it
+//needs, either by parsing the data whole or by streaming it. Streaming
+//is possible only for uncompressed bitmaps, and not for encoding
+//adaptively since the blocks used depend on the whole image.
+void footprints(WATCH_SETTINGS* settings, BMP_FILE* file, PAYLOAD_INFO* info,
+	uint64_t* whole, uint64_t* streamed){
+
+	uint64_t size = dataSize(file);
+	PAYLOAD_INFO header;
+	int streamable = file->bpp == 24 && file->compression == BI_RGB;
+
+	*whole = parseFootprint(file);
+	*streamed = 0;
+
+	if(settings->options->decode){
+		//The stored bytes and the payload, or a message written
+		//with the encodeData()-function.
+		uint64_t message = size / 4 + 2;
+		if(streamable && loadHeader(file, &header)){
+			uint64_t used = payloadAreaSize(header.length, &header);
+			message = (uint64_t) header.storedLength + header.length + 2;
+			*streamed = (used < size ? used : size) + message;
+		}
+		else if(streamable)
+			*streamed = STREAM_CHUNK + size / 8 + 1;
+
+		*whole += message;
+		return;
+	}
+
+	uint64_t stored = (info->flags & PAYLOAD_FLAG_FEC) ? fecSize(settings->length, info->fecParity) : 0;
+	*whole += stored;
+
+	if(streamable && !(info->flags & PAYLOAD_FLAG_ADAPTIVE)){
+		uint64_t used = settings->options->headered ? payloadAreaSize(settings->length, info)
+			: legacySize(settings->length);
+		*streamed = (used < size ? used : size) + stored;
+	}
+}
+
+//Encodes or decodes a single file of the watch mode to the output
+//directory. The output is written to a temporary file first, so
+//a file in the output directory is always complete.
+//The memory needed is reserved from the budget before the data is
+//read, waiting for the other workers if needed. A file needing more
+//than its share of the budget is streamed when possible.
+//Returns a description of the failure, or NULL on success.
+const char* processFile(WATCH_SETTINGS* settings, WATCH_ENTRY* entry){
+	char temporary[WATCH_PATH_LENGTH + WATCH_NAME_LENGTH + 8],
+		 target[WATCH_PATH_LENGTH + WATCH_NAME_LENGTH + 8];
+	PAYLOAD_INFO info = settings->options->payload;
+	JOB_CONTROL control;
+	const char* failure = NULL;
+
+	snprintf(temporary, sizeof(temporary), "%s/.%s.tmp", settings->output, entry->name);
+	snprintf(target, sizeof(target), "%s/%s%s", settings->output, entry->name, settings->options->decode ? ".txt" : "");
+
+	BMP_FILE* file = openBmp(entry->path);
+	if(file == NULL)
+		return "the file could not be opened";
+
+	jobInit(&control);
+	jobSetTimeout(&control, settings->options->timeout);
+	file->control = &control;
+	file->dropCache = settings->options->dropCache;
+
+	if(!parseHeader(file))
+		failure = "not a valid or supported bitmap";
+	else{
+		uint64_t whole, streamed;
+
+		info.rowBytes = rowBytes(file);
+		footprints(settings, file, &info, &whole, &streamed);
+
+		int streaming = streamed > 0 && (whole > settings->share && settings->share > 0);
+		uint64_t needed = streaming ? streamed : whole;
+
+		if(!budgetReserve(&settings->budget, needed))
+			failure = "the file is too large for the memory budget";
+		else{
+			if(streaming)
+				failure = processStreamed(settings, file, &info, temporary);
+			else
+				failure = processWhole(settings, file, &info, temporary);
+			budgetRelease(&settings->budget, needed);
+		}
+	}
+
+	if(failure == NULL && rename(temporary, target) != 0)
+		failure = "the output could not be written";
+
+	if(failure != NULL)
+		remove(temporary);
+
+	closeBmp(file);
+	return failure;
+}
+
+//Handles a file reported by the watch, called from the worker threads.
+void watchWork(void* context, void* item){
+	WATCH_SETTINGS* settings = context;
+	WATCH_ENTRY* entry = item;
+	const char* failure = processFile(settings, entry);
+
+	//The file is recorded as handled also when it failed, since
+	//it would fail again. A new version of it is handled again.
+	markProcessed(settings->watch, entry);
+
+	if(failure == NULL)
+		printf("%s: %s in %.1f ms\n", entry->name, settings->options->decode ? "decoded" : "encoded",
+			(monotonicTime() - entry->landed) * 1000);
+	else
+		printf("%s: FAILED (%s)\n", entry->name, failure);
+	fflush(stdout);
+
+	free(entry);
+}
+
+//Passes the files reported by the watch to the worker threads.
+void watchReady(void* context, WATCH_ENTRY* entry){
+	WORK_QUEUE* queue = context;
+
+	if(!pushWork(queue, entry))
+		free(entry);
+}
+
+//Stops the watch mode.
+void watchInterrupt(int number){
+	(void) number;
+	stopWatch = 1;
+}
+
+//Handles the watch mode: the bitmaps written to the given directory
+//are encoded or decoded to the output directory as soon as they have
+//been written. Returns 0 on failure.
+int watchOperation(char* directory, OPTIONS* options){
+	char defaultOutput[WATCH_PATH_LENGTH], state[WATCH_PATH_LENGTH],
+		 realInput[PATH_MAX], realOutput[PATH_MAX];
+	WATCH_SETTINGS settings;
+
+	memset(&settings, 0, sizeof(WATCH_SETTINGS));
+	settings.options = options;
+	settings.output = options->output;
+	if(settings.output == NULL){
+		snprintf(defaultOutput, sizeof(defaultOutput), "%s/%s", directory, options->decode ? "decoded" : "encoded");
+		settings.output = defaultOutput;
+	}
+	if(mkdir(settings.output, 0777) != 0 && errno != EEXIST){
+		printf("The output directory %s could not be created.\n", settings.output);
+		return 0;
+	}
+	if(realpath(directory, realInput) == NULL || realpath(settings.output, realOutput) == NULL
+		|| strcmp(realInput, realOutput) == 0){
+		puts("The output directory must exist and be different from the watched directory.\n");
+		return 0;
+	}
+
+	//The message is read once and shared by all the files.
+	if(!options->decode){
+		if(options->entries > 0 && options->headered){
+			settings.message = buildContainer(options, &settings.length);
+			options->payload.flags = (options->payload.flags & ~PAYLOAD_FLAG_FEC) | PAYLOAD_FLAG_CONTAINER;
+		}
+		else if(options->message != NULL){
+			if((settings.message = readFile(options->message, &settings.length)) == NULL)
+				printf("The file %s could not be read.\n", options->message);
+		}
+		else
+			puts("The watch mode needs the message in a file given with --message, or entries given with --add.\n");
+
+		if(settings.message == NULL)
+			return 0;
+	}
+
+	snprintf(state, sizeof(state), "%s/.bmpcoder-state", settings.output);
+	settings.watch = openWatch(directory, state);
+	if(settings.watch == NULL || settings.watch->error != WATCH_OK){
+		if(settings.watch != NULL && settings.watch->error == WATCH_NOT_SUPPORTED)
+			puts("Watching directories is not supported on this system.\n");
+		else
+			printf("The directory %s could not be watched.\n", directory);
+		closeWatch(settings.watch);
+		free(settings.message);
+		return 0;
+	}
+
+	WORK_QUEUE* queue = createQueue(options->workers, watchWork, &settings);
+	if(queue == NULL){
+		puts("Not enough memory available for operations.\nTerminating program.");
+		closeWatch(settings.watch);
+		free(settings.message);
+		return 0;
+	}
+
+	//Each worker may read a file whole if it fits its share of the
+	//budget, so the workers rarely have to wait for each other.
+	budgetInit(&settings.budget, options->memory);
+	settings.share = options->memory / queue->workers;
+
+	printf("Watching %s, the results are written to %s. Press Ctrl-C to stop.\n", directory, settings.output);
+	fflush(stdout);
+
+	signal(SIGINT, watchInterrupt);
+	signal(SIGTERM, watchInterrupt);
+	int success = runWatch(settings.watch, watchReady, queue, &stopWatch);
+
+	//The files allready reported are handled before stopping.
+	destroyQueue(queue);
+	printMemory(stdout, &settings.budget);
+	if(cache != NULL)
+		printf("Cache: %llu hits, %llu misses\n", (unsigned long long) cache->hits, (unsigned long long) cache->misses);
+	budgetDestroy(&settings.budget);
+	closeWatch(settings.watch);
+	free(settings.message);
+	return success;
+}
+
+//Prints the progress of the job to stderr when the percentage changes.
+void printProgress(void* context, uint64_t done, uint64_t total){
+	static int last = -1;
+	int percent = total > 0 ? (int) (done * 100 / total) : 100;
+
+	(void) context;
+	if(percent == last)
+		return;
+
+	last = percent;
+	fprintf(stderr, "\r%3d%%", percent);
+	if(done >= total){
+		fprintf(stderr, "\n");
+		last = -1;
+	}
+}
+
+//Cancels the job on the first interrupt, the second one
+//terminates the program as usual.
+void interrupt(int number){
+	jobCancel(&job);
+	signal(number, SIG_DFL);
+}
+
+int main(int argc, char** argv){
+	OPTIONS options;
+
+	payloadInit();
+
+	if(argc < 3){
+		help();
+		return(EXIT_SUCCESS);
+	}
+	if(strncasecmp(argv[1], "-v", 2) == 0)
+		return verifyOperation(argc - 2, &argv[2]) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	if(strncasecmp(argv[1], "-i", 2) == 0)
+		return infoOperation(argc - 2, &argv[2]) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	if(strncasecmp(argv[1], "-s", 2) == 0)
+		return screenOperation(argc - 2, &argv[2]) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	if(!parseOptions(argc, argv, &options)){
+		help();
+		return(EXIT_FAILURE);
+	}
+
+	if(options.cacheDirectory != NULL){
+		cache = openCache(options.cacheDirectory, options.cacheLimit);
+		if(cache == NULL || cache->error != CACHE_OK){
+			printf("The cache directory %s could not be opened.\n", options.cacheDirectory);
+			closeCache(cache);
+			return(EXIT_FAILURE);
+		}
+	}
+
+	if(strncasecmp(argv[1], "-w", 2) == 0){
+		int success = watchOperation(argv[2], &options);
+		closeCache(cache);
+		return success ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	dropPageCache = options.dropCache;
+	jobInit(&job);
+	jobSetTimeout(&job, options.timeout);
+	if(options.progress)
+		job.progress = printProgress;
+	signal(SIGINT, interrupt);
+
+	if(strncasecmp(argv[1], "-e" , 2) == 0){
+		if(!encodeOperation(argv[2], &options)){
+			closeCache(cache);
+			return(EXIT_FAILURE);
+		}
+	}
+
+	else if(strncasecmp(argv[1], "-d", 2) == 0)
+		decodeOperation(argv[2], &options);
+
+	else if(strncasecmp(argv[1], "-a", 2) == 0)
+		appendOperation(argv[2], 0);
+
+	else if(strncasecmp(argv[1], "-r", 2) == 0)
+		appendOperation(argv[2], 1);
+
+	else
+		help();
+
+	closeCache(cache);
 	return(EXIT_SUCCESS);
 }
@@ -65,6 +65,42 @@ int isBigEndian(){
 		return 1;
 }
 
+/*
+ * The byte order of the machine is known at compile time, so the
+ * conversions below compile to a plain load on little-endian machines
+ * and to a load and a byte swap on big-endian ones. Compilers not
+ * telling the byte order fall back to the isBigEndian()-function.
+ */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+uint32_t toUInt(uint8_t* bytes){
+	uint32_t i;
+	memcpy(&i, bytes, sizeof(uint32_t));
+	return i;
+}
+
+uint16_t toUShort(uint8_t* bytes){
+	uint16_t s;
+	memcpy(&s, bytes, sizeof(uint16_t));
+	return s;
+}
+
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+
+uint32_t toUInt(uint8_t* bytes){
+	uint32_t i;
+	memcpy(&i, bytes, sizeof(uint32_t));
+	return __builtin_bswap32(i);
+}
+
+uint16_t toUShort(uint8_t* bytes){
+	uint16_t s;
+	memcpy(&s, bytes, sizeof(uint16_t));
+	return __builtin_bswap16(s);
+}
+
+#else
+
 uint32_t toUInt(uint8_t* bytes){
 	uint32_t i;
 
@@ -102,6 +138,15 @@ uint16_t toUShort(uint8_t* bytes){
 	return s;
 }
 
+#endif
+
+void fromUInt(uint32_t i, uint8_t* bytes){
+	for(unsigned int j = 0; j < sizeof(uint32_t); j++){
+		bytes[j] = (uint8_t) i;
+		i >>= 8;
+	}
+}
+
 void encodeData(uint8_t* area, char* message){
 	if(area == NULL || message == NULL)
 		return;
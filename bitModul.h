@@ -15,6 +15,7 @@ Functions:
 	int isBigEndian()
 	unsigned int toInteger(byte*)
 	unsigned short toShort(byte*)
+	void fromUInt(uint32_t, byte*)
 	void encodeData(byte*, char*)
 	char* decodeData(byte*, int)
 
@@ -161,6 +162,8 @@ Function: toUInt(uint8_t*)
 
 Purpose: Turns the given LITTLE-ENDIAN byte array
 	to unsigned 32 bit integer.
+	The byte order of the machine is checked at compile
+	time when the compiler tells it.
 
 Inputs: An array of bytes representing an unsigned
 	integer in little-endian format.
@@ -202,6 +205,29 @@ Sample call: uint16_t s = toUShort(myArray);
 ********************************************/
 uint16_t toUShort(uint8_t*);
 
+/********************************************
+Function: fromUInt(uint32_t, byte*)
+
+Purpose: Stores the given unsigned 32 bit integer to
+	the given byte array in LITTLE-ENDIAN format.
+	This is the reverse of the toUInt()-function.
+
+Inputs: The integer to be stored and the array where
+	it should be stored.
+	The array must have space for atleast
+	sizeof(uint32_t) bytes.
+
+Returns: Nothing.
+
+Modifies: Overwrites the first sizeof(uint32_t) bytes
+	  of the given array.
+
+Error checking: None.
+
+Sample call: fromUInt(1234, myArray);
+********************************************/
+void fromUInt(uint32_t, uint8_t*);
+
 /********************************************
 Function: encodeData(byte*, char*)
 
@@ -1,8 +1,82 @@
+#define _POSIX_C_SOURCE 200809L
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #include "bitModul.h"
+#include "jobControl.h"
 #include "bmpFileParser.h"
 
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+//The amount of bytes copied at a time when the output can not be
+//cloned, so that the job is checked while copying.
+#define COPY_CHUNK (8 << 20)
+
+//The size of a block of the ring used by the pipeFile()-function,
+//and the amount of blocks in the ring.
+#define PIPE_BLOCK (4 << 20)
+#define PIPE_SLOTS 4
+
+//The amount of bytes read or written between dropping them from
+//the page cache, when the dropCache variable of the struct is set.
+#define DROP_CHUNK (8 << 20)
+
+//Drops the pages of the descriptor in [start, start + length) from
+//the page cache, a length of 0 meaning the rest of the file. Written
+//pages are dirty and can not be dropped, so they are first written
+//to the disk.
+static void dropPages(int fd, off_t start, off_t length, int written){
+#ifdef __linux__
+	if(written)
+		sync_file_range(fd, start, length, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#else
+	if(written)
+		fdatasync(fd);
+#endif
+	posix_fadvise(fd, start, length, POSIX_FADV_DONTNEED);
+}
+
+//Called while the output grows to the given position: once a chunk
+//has been written it is passed to the disk without waiting, and the
+//chunk before it, most likely on the disk by now, is dropped from the
+//page cache. This way the writing is not slowed down by waiting.
+static void writeBehind(int fd, off_t* started, off_t* dropped, off_t position){
+	if(position - *started < DROP_CHUNK)
+		return;
+
+#ifdef __linux__
+	sync_file_range(fd, *started, position - *started, SYNC_FILE_RANGE_WRITE);
+#endif
+	if(*started > *dropped)
+		dropPages(fd, *dropped, *started - *dropped, 1);
+	*dropped = *started;
+	*started = position;
+}
+
+//Checks that the data of the given dimensions, decompressed to
+//24 bpp, fits in 32 bits, and that uncompressed data fits in the
+//file of the given size.
+static int sizeFits(int32_t width, int32_t height, int16_t bpp, uint32_t compression, uint32_t offset, uint64_t fileSize){
+	if(width <= 0 || height <= 0 || bpp <= 0)
+		return 1;
+
+	if((uint64_t) width * 3 * (uint64_t) height > UINT32_MAX)
+		return 0;
+
+	uint64_t stride = (((uint64_t) width * bpp + 31) / 32) * 4;
+	return compression != BI_RGB || offset + stride * height <= fileSize;
+}
+
 unsigned int skipBytes(FILE* file, unsigned int n){
 	if(file == NULL || n == 0)
 		return 0;
@@ -30,6 +104,12 @@ BMP_FILE* openBmp(char* fileName){
 	p->data = NULL;
 	p->error = NO_ERROR;
 	p->headerParsed = 0;
+	p->headerChanged = 0;
+	p->changedKnown = 0;
+	p->control = NULL;
+	p->rowRead = NULL;
+	p->rowWritten = NULL;
+	p->dropCache = 0;
 	
 	return p;
 }
@@ -87,6 +167,7 @@ int parseHeader(BMP_FILE* file){
 	file->bpp 		  = toUShort(&headerData[10]);
 	file->compression = toUInt(&headerData[12]);
 	file->imgSize 	  = toUInt(&headerData[16]);
+	file->colors 	  = file->hSize >= 36 ? toUInt(&headerData[28]) : 0;
 
 	/* Each line of a bmp file is padded to be divisible by 32.
 	 * The following formula counts the amount of bytes needed
@@ -97,12 +178,214 @@ int parseHeader(BMP_FILE* file){
 	if(file->padding == 4)
 		file->padding = 0;
 
+	struct stat info;
+	if(fstat(fileno(file->fileHandle), &info) != 0 || !sizeFits(file->width, file->height, file->bpp,
+		file->compression, file->offset, info.st_size)){
+		NOT_VALID_ERROR(file);
+	}
+
 	file->error = NO_ERROR;
 	file->headerParsed = 1;	
 
 	return 1;
 }
 
+/*
+ * Decodes BI_RLE8 or BI_RLE4 data to one palette index per pixel.
+ * Runs are expanded with memset and absolute runs of RLE8 with memcpy.
+ * Every run is checked against the bitmap bounds once, so corrupt data
+ * is detected without checks for each pixel.
+ * The job is checked at the end of each line and at each delta.
+ * Returns 1 on success, 0 if the data has runs outside the bitmap
+ * and -1 if the job was stopped.
+ */
+static int decodeRle(uint8_t* in, size_t size, uint8_t* indices, int32_t width, int32_t height, int rle4,
+	JOB_CONTROL* control){
+	size_t pos = 0;
+	int32_t x = 0, y = 0;
+
+	while(pos + 2 <= size){
+		unsigned int count = in[pos],
+					 value = in[pos + 1];
+		pos += 2;
+
+		if(count > 0){
+			//Encoded run of count pixels
+			if(y >= height || count > (unsigned int) (width - x))
+				return 0;
+
+			uint8_t* row = &indices[(size_t) y * width + x];
+			if(!rle4 || (value >> 4) == (value & 0x0F))
+				memset(row, rle4 ? value & 0x0F : value, count);
+			else{
+				//RLE4 runs alternate between the two nibbles.
+				for(unsigned int i = 0; i < count; i++)
+					row[i] = (i & 1) ? value & 0x0F : value >> 4;
+			}
+			x += count;
+			continue;
+		}
+
+		switch(value){
+			case 0:		//End of line
+				x = 0;
+				y++;
+				if(control != NULL && !jobCheck(control, pos))
+					return -1;
+				break;
+
+			case 1:		//End of bitmap
+				return 1;
+
+			case 2:		//Delta, the skipped pixels have the index 0
+				if(pos + 2 > size)
+					return 0;
+				x += in[pos];
+				y += in[pos + 1];
+				pos += 2;
+				if(x > width)
+					return 0;
+				if(control != NULL && !jobCheck(control, pos))
+					return -1;
+				break;
+
+			default:{	//Absolute run of value pixels, padded to 16 bits
+				size_t bytes = rle4 ? (value + 1) / 2 : value;
+				if(y >= height || value > (unsigned int) (width - x) || pos + bytes > size)
+					return 0;
+
+				uint8_t* row = &indices[(size_t) y * width + x];
+				if(!rle4)
+					memcpy(row, &in[pos], value);
+				else{
+					for(unsigned int i = 0; i < value; i++)
+						row[i] = (i & 1) ? in[pos + i / 2] & 0x0F : in[pos + i / 2] >> 4;
+				}
+				x += value;
+				pos += (bytes + 1) & ~(size_t) 1;
+			}
+		}
+	}
+	//Data ending without the end of bitmap marker is accepted.
+	return 1;
+}
+
+//Parses the data of a BI_RLE8 or BI_RLE4 compressed bitmap to
+//the 24 bpp format.
+static int parseRleData(BMP_FILE* file){
+	int rle4 = file->compression == BI_RLE4;
+
+	if(file->bpp != (rle4 ? 4 : 8) || file->width <= 0 || file->height <= 0){
+		NOT_VALID_ERROR(file);
+	}
+
+	//The palette follows the headers, each colour takes 4 bytes.
+	uint8_t palette[256][4];
+	unsigned int colors = file->colors;
+	if(colors == 0 || colors > (1u << file->bpp))
+		colors = 1u << file->bpp;
+
+	memset(palette, 0, sizeof(palette));
+	if(fseek(file->fileHandle, 14 + file->hSize, SEEK_SET) != 0 ||
+		fread(palette, 4, colors, file->fileHandle) != colors){
+		NOT_VALID_ERROR(file);
+	}
+
+	//The size of the compressed data is given by the header, or by
+	//the file size if the header leaves it out.
+	size_t size = file->imgSize;
+	if(size == 0)
+		size = file->fSize > file->offset ? file->fSize - file->offset : 0;
+
+	size_t pixels = (size_t) file->width * file->height;
+	uint8_t* compressed = malloc(size + 1);
+	uint8_t* indices = calloc(pixels, 1);
+	uint8_t* data = malloc(pixels * 3);
+
+	if(compressed == NULL || indices == NULL || data == NULL){
+		free(compressed);
+		free(indices);
+		free(data);
+		MEMORY_ALLOCATION_ERROR(file);
+	}
+
+	//A truncated file is decoded as far as it goes.
+	if(fseek(file->fileHandle, file->offset, SEEK_SET) != 0)
+		size = 0;
+	size = fread(compressed, 1, size, file->fileHandle);
+	if(file->dropCache)
+		dropPages(fileno(file->fileHandle), 0, 0, 0);
+
+	//The progress is counted as the compressed bytes decoded
+	//followed by the pixels looked up from the palette.
+	jobStart(file->control, size + pixels);
+
+	int valid = decodeRle(compressed, size, indices, file->width, file->height, rle4, file->control);
+	free(compressed);
+	if(valid <= 0){
+		free(indices);
+		free(data);
+		if(valid < 0){
+			JOB_STOPPED_ERROR(file);
+		}
+		NOT_VALID_ERROR(file);
+	}
+
+	//The palette entries are stored in the same blue, green, red
+	//order as the pixels of a 24 bpp bitmap.
+	for(int32_t y = 0; y < file->height; y++){
+		size_t first = (size_t) y * file->width;
+
+		for(size_t i = first; i < first + file->width; i++)
+			memcpy(&data[i * 3], palette[indices[i]], 3);
+
+		if(file->rowRead != NULL)
+			file->rowRead(file->rowContext, &data[first * 3], file->width * 3);
+		if(file->control != NULL && !jobCheck(file->control, size + first + file->width)){
+			free(indices);
+			free(data);
+			JOB_STOPPED_ERROR(file);
+		}
+	}
+	free(indices);
+
+	if(file->data != NULL)
+		free(file->data);
+	file->data = data;
+
+	//From now on the struct describes an uncompressed 24 bpp bitmap.
+	file->bpp = 24;
+	file->compression = BI_RGB;
+	file->colors = 0;
+	file->padding = (4 - (file->width * 3) % 4) % 4;
+	file->padder = 0;
+	file->imgSize = (file->width * 3 + file->padding) * file->height;
+	file->hSize = 40;
+	file->offset = 54;
+	file->fSize = file->offset + file->imgSize;
+	file->headerChanged = 1;
+
+	file->error = NO_ERROR;
+	return 1;
+}
+
+//Writes a header for an uncompressed 24 bpp bitmap.
+static int writeHeader(BMP_FILE* file, FILE* output){
+	uint8_t header[54] = {0x42, 0x4D};
+
+	fromUInt(file->fSize, &header[2]);
+	fromUInt(file->offset, &header[10]);
+	fromUInt(file->hSize, &header[14]);
+	fromUInt((uint32_t) file->width, &header[18]);
+	fromUInt((uint32_t) file->height, &header[22]);
+	header[26] = 1;		//The amount of planes
+	header[28] = 24;	//Bits per pixel
+	fromUInt(file->compression, &header[30]);
+	fromUInt(file->imgSize, &header[34]);
+
+	return fwrite(header, 1, sizeof(header), output) == sizeof(header);
+}
+
 int parseData(BMP_FILE* file){
 	if(file == NULL)
 		return 0;
@@ -115,57 +398,499 @@ int parseData(BMP_FILE* file){
 		NULL_FILE_ERROR(file);
 	}
 
-	if(file->bpp != 24){
+	if(file->compression == BI_RLE8 || file->compression == BI_RLE4)
+		return parseRleData(file);
+
+	if(file->bpp != 24 || file->compression != BI_RGB){
 		NOT_VALID_ERROR(file);
 	}
 
 	if(file->data != NULL)
 		free(file->data);
 
+	file->changedKnown = 0;
 	if((file->data = malloc(dataSize(file))) == NULL){
 		MEMORY_ALLOCATION_ERROR(file);
 	}
 
-	rewind(file->fileHandle);
-
-	//We try to skip the header part of the file:
-	if((skipBytes(file->fileHandle, file->offset)) != file->offset){
+	if(fseek(file->fileHandle, file->offset, SEEK_SET) != 0){
 		NOT_VALID_ERROR(file);
 	}
 
-	int read  = 0, //The char read from file
-	    index = 0; //The current index of the data array.
+	unsigned int rowBytes = file->width * 3;
+	uint8_t padding[4];
+	off_t dropped = 0;
 
+	jobStart(file->control, dataSize(file));
+	if(file->dropCache)
+		posix_fadvise(fileno(file->fileHandle), 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	//The data is read one row at a time, the padding bytes are
+	//read separately and the first one is saved for writing.
 	for(int i = 0; i < file->height; i++){
-		//file->widht * 3 tells the amount of bytes on each line of this bitmap.
-		for(int j = 0; j < file->width * 3; j++){
-			if((read = fgetc(file->fileHandle)) == EOF){
+		if(fread(&file->data[(size_t) i * rowBytes], 1, rowBytes, file->fileHandle) != rowBytes){
+			NOT_VALID_ERROR(file);
+		}
+		if(file->padding != 0){
+			if(fread(padding, 1, file->padding, file->fileHandle) != file->padding){
 				NOT_VALID_ERROR(file);
 			}
-			file->data[index] = (uint8_t) read;
-			index++;
+			if(i == 0)
+				file->padder = padding[0];
 		}
-		//On the first line we will also read the byte used for padding:
-		if(i == 0 && file->padding != 0){
-			if((read = fgetc(file->fileHandle)) == EOF){
-				NOT_VALID_ERROR(file);
+		if(file->rowRead != NULL)
+			file->rowRead(file->rowContext, &file->data[(size_t) i * rowBytes], rowBytes);
+		if(file->dropCache && ftello(file->fileHandle) - dropped >= DROP_CHUNK){
+			off_t position = ftello(file->fileHandle);
+			dropPages(fileno(file->fileHandle), dropped, position - dropped, 0);
+			dropped = position;
+		}
+		if(file->control != NULL && !jobCheck(file->control, (uint64_t) (i + 1) * rowBytes)){
+			JOB_STOPPED_ERROR(file);
+		}
+	}
+	if(file->dropCache)
+		dropPages(fileno(file->fileHandle), 0, 0, 0);
+	file->error = NO_ERROR;
+	return 1;
+}
+
+static int rangeErrors(BMP_FILE*, unsigned int, unsigned int);
+
+void markChanged(BMP_FILE* file, unsigned int start, unsigned int length){
+	unsigned int end = start + length;
+
+	if(!file->changedKnown){
+		file->changedKnown = 1;
+		file->changedStart = start;
+		file->changedEnd = end;
+		return;
+	}
+	if(start < file->changedStart)
+		file->changedStart = start;
+	if(end > file->changedEnd)
+		file->changedEnd = end;
+}
+
+//Writes the data bytes [start, start + length) from the buffer to the
+//given descriptor, wich must hold a copy of the file of the struct.
+static int writeRows(BMP_FILE* file, int fd, uint8_t* buffer, unsigned int start, unsigned int length){
+	unsigned int rowBytes = file->width * 3;
+
+	while(length > 0){
+		unsigned int row = start / rowBytes,
+					 column = start % rowBytes,
+					 amount = rowBytes - column;
+		if(amount > length)
+			amount = length;
+
+		off_t position = file->offset + (off_t) row * (rowBytes + file->padding) + column;
+		if(pwrite(fd, buffer, amount, position) != (ssize_t) amount){
+			FILE_WRITING_ERROR(file);
+		}
+		if(file->rowWritten != NULL)
+			file->rowWritten(file->rowContext, start, buffer, amount);
+		buffer += amount;
+		start += amount;
+		length -= amount;
+	}
+	return 1;
+}
+
+//Makes the output a copy of the input sharing its extents, on
+//filesystems supporting it. Returns 0 if the file was not cloned.
+static int cloneFile(int input, int output){
+#if defined(__linux__) && defined(FICLONE)
+	return ioctl(output, FICLONE, input) == 0;
+#else
+	(void) input;
+	(void) output;
+	return 0;
+#endif
+}
+
+//Makes the output a copy of the original file. The copy shares the
+//extents of the original on filesystems supporting it, otherwise the
+//kernel copies the data without it passing through this program. If
+//neither is supported the data is copied through a buffer.
+static int copyFile(BMP_FILE* file, int output){
+	int input = fileno(file->fileHandle),
+		kernelCopy = 1;
+	uint8_t buffer[1 << 16];
+	struct stat info;
+	off_t done = 0, started = 0, dropped = 0;
+
+	if(fstat(input, &info) != 0){
+		NOT_VALID_ERROR(file);
+	}
+
+	if(cloneFile(input, output))
+		return 1;
+
+	jobStart(file->control, info.st_size);
+
+	while(done < info.st_size){
+		size_t amount = info.st_size - done < COPY_CHUNK ? info.st_size - done : COPY_CHUNK;
+		ssize_t copied = -1;
+
+#ifdef __linux__
+		loff_t in = done, out = done;
+		if(kernelCopy && (copied = copy_file_range(input, &in, output, &out, amount, 0)) <= 0)
+			kernelCopy = 0;
+#endif
+		if(copied <= 0){
+			copied = pread(input, buffer, amount < sizeof(buffer) ? amount : sizeof(buffer), done);
+			if(copied <= 0 || pwrite(output, buffer, copied, done) != copied){
+				FILE_WRITING_ERROR(file);
 			}
-			file->padder = (uint8_t) read;
-			skipBytes(file->fileHandle, file->padding - 1);
-			continue;
 		}
-		//Skips the padding bytes in this line:
-		if(skipBytes(file->fileHandle, file->padding) != file->padding){
-			NOT_VALID_ERROR(file);
+		done += copied;
+
+		if(file->dropCache){
+			dropPages(input, done - copied, copied, 0);
+			writeBehind(output, &started, &dropped, done);
+		}
+		if(file->control != NULL && !jobCheck(file->control, done)){
+			JOB_STOPPED_ERROR(file);
 		}
 	}
+	return 1;
+}
+
+//Writes a copy of the original file with the data bytes
+//[start, start + length) replaced by the buffer.
+static int writeCopy(BMP_FILE* file, char* fname, uint8_t* buffer, unsigned int start, unsigned int length){
+	int output = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+	if(output < 0){
+		FILE_WRITING_ERROR(file);
+	}
+
+	int success = copyFile(file, output) && writeRows(file, output, buffer, start, length);
+	if(success && file->dropCache)
+		dropPages(output, 0, 0, 1);
+
+	if(close(output) != 0 && success){
+		file->error = FILE_WRITING_ERROR;
+		success = 0;
+	}
+	if(!success){
+		remove(fname);
+		return 0;
+	}
 	file->error = NO_ERROR;
 	return 1;
 }
 
+int writeRangeToFile(BMP_FILE* file, char* fname, uint8_t* buffer, unsigned int start, unsigned int length){
+	if(file == NULL)
+		return 0;
+
+	if(!rangeErrors(file, start, length))
+		return 0;
+
+	return writeCopy(file, fname, buffer, start, length);
+}
+
+//The states of a block in the ring of the pipeFile()-function.
+typedef enum{
+	PIPE_FREE,			//The block may be filled by the reader
+	PIPE_READ,			//The block holds rows read from the file
+	PIPE_PROCESSED		//The block may be written by the writer
+}PIPE_STATE;
+
+//The state shared by the stages of the pipeFile()-function.
+typedef struct{
+	BMP_FILE* file;
+	int input, output;				//The descriptors of the files
+	unsigned int rowBytes, stride;	//The data bytes and the file bytes of a row
+	unsigned int blockRows;			//The amount of rows in a block
+	unsigned int blocks;			//The amount of blocks in the data
+	uint8_t* buffer;				//The new data bytes
+	unsigned int start, end;		//The data bytes [start, end) replaced by the buffer
+
+	uint8_t* slots[PIPE_SLOTS];		//The ring of blocks
+	PIPE_STATE states[PIPE_SLOTS];	//The states of the blocks
+	pthread_mutex_t lock;			//Protects the states
+	pthread_cond_t changed;			//Signalled when a state changes
+	int failed;						//Is 1 if a stage failed, all the stages stop
+	ERROR_NO error;					//The error of the failed stage
+}PIPE;
+
+//Waits until the block is in the given state. Returns 0 if a stage
+//has failed.
+static int pipeWait(PIPE* pipe, unsigned int block, PIPE_STATE state){
+	pthread_mutex_lock(&pipe->lock);
+	while(!pipe->failed && pipe->states[block % PIPE_SLOTS] != state)
+		pthread_cond_wait(&pipe->changed, &pipe->lock);
+	int running = !pipe->failed;
+	pthread_mutex_unlock(&pipe->lock);
+	return running;
+}
+
+static void pipeSet(PIPE* pipe, unsigned int block, PIPE_STATE state){
+	pthread_mutex_lock(&pipe->lock);
+	pipe->states[block % PIPE_SLOTS] = state;
+	pthread_cond_broadcast(&pipe->changed);
+	pthread_mutex_unlock(&pipe->lock);
+}
+
+static void pipeFail(PIPE* pipe, ERROR_NO error){
+	pthread_mutex_lock(&pipe->lock);
+	if(!pipe->failed)
+		pipe->error = error;
+	pipe->failed = 1;
+	pthread_cond_broadcast(&pipe->changed);
+	pthread_mutex_unlock(&pipe->lock);
+}
+
+//The rows of a block and the position of the block in the file.
+static unsigned int blockRows(PIPE* pipe, unsigned int block, off_t* position){
+	unsigned int first = block * pipe->blockRows, rows = pipe->blockRows;
+
+	if(first + rows > (unsigned int) pipe->file->height)
+		rows = pipe->file->height - first;
+	*position = pipe->file->offset + (off_t) first * pipe->stride;
+	return rows;
+}
+
+//Copies the bytes [start, end) of the input to the output.
+static int pipeCopy(PIPE* pipe, off_t start, off_t end){
+	uint8_t* buffer = pipe->slots[0];
+
+	while(start < end){
+		size_t amount = end - start < PIPE_BLOCK ? end - start : PIPE_BLOCK;
+		ssize_t copied = pread(pipe->input, buffer, amount, start);
+
+		if(copied <= 0 || pwrite(pipe->output, buffer, copied, start) != copied)
+			return 0;
+		start += copied;
+	}
+	return 1;
+}
+
+static void* pipeReader(void* argument){
+	PIPE* pipe = argument;
+	off_t position;
+
+	for(unsigned int block = 0; block < pipe->blocks; block++){
+		if(!pipeWait(pipe, block, PIPE_FREE))
+			return NULL;
+
+		size_t length = (size_t) blockRows(pipe, block, &position) * pipe->stride;
+		uint8_t* slot = pipe->slots[block % PIPE_SLOTS];
+		for(size_t done = 0; done < length;){
+			ssize_t amount = pread(pipe->input, slot + done, length - done, position + done);
+			if(amount <= 0){
+				pipeFail(pipe, NOT_VALID_BITMAP_ERROR);
+				return NULL;
+			}
+			done += amount;
+		}
+		if(pipe->file->dropCache)
+			dropPages(pipe->input, position, length, 0);
+		pipeSet(pipe, block, PIPE_READ);
+	}
+	return NULL;
+}
+
+static void* pipeWriter(void* argument){
+	PIPE* pipe = argument;
+	off_t position, started = 0, dropped = 0;
+
+	for(unsigned int block = 0; block < pipe->blocks; block++){
+		if(!pipeWait(pipe, block, PIPE_PROCESSED))
+			return NULL;
+
+		unsigned int rows = blockRows(pipe, block, &position);
+		uint8_t* slot = pipe->slots[block % PIPE_SLOTS];
+		size_t length = (size_t) rows * pipe->stride;
+		for(size_t done = 0; done < length;){
+			ssize_t amount = pwrite(pipe->output, slot + done, length - done, position + done);
+			if(amount <= 0){
+				pipeFail(pipe, FILE_WRITING_ERROR);
+				return NULL;
+			}
+			done += amount;
+		}
+		for(unsigned int i = 0; pipe->file->rowWritten != NULL && i < rows; i++)
+			pipe->file->rowWritten(pipe->file->rowContext, (block * pipe->blockRows + i) * pipe->rowBytes,
+				&slot[(size_t) i * pipe->stride], pipe->rowBytes);
+		if(pipe->file->dropCache)
+			writeBehind(pipe->output, &started, &dropped, position + length);
+		pipeSet(pipe, block, PIPE_FREE);
+	}
+	return NULL;
+}
+
+//Replaces the data bytes of the row inside the replaced range with
+//the bytes of the buffer.
+static void patchRow(PIPE* pipe, unsigned int first, uint8_t* row){
+	unsigned int from = first > pipe->start ? first : pipe->start,
+				 to = first + pipe->rowBytes < pipe->end ? first + pipe->rowBytes : pipe->end;
+
+	if(from < to)
+		memcpy(&row[from - first], &pipe->buffer[from - pipe->start], to - from);
+}
+
+//Patches the blocks read by the reader, on the calling thread, and
+//passes them on to the writer.
+static int pipeProcess(PIPE* pipe){
+	off_t position;
+
+	jobStart(pipe->file->control, dataSize(pipe->file));
+
+	for(unsigned int block = 0; block < pipe->blocks; block++){
+		if(!pipeWait(pipe, block, PIPE_READ))
+			return 0;
+
+		unsigned int rows = blockRows(pipe, block, &position);
+		uint8_t* slot = pipe->slots[block % PIPE_SLOTS];
+		for(unsigned int i = 0; i < rows; i++)
+			patchRow(pipe, (block * pipe->blockRows + i) * pipe->rowBytes, &slot[(size_t) i * pipe->stride]);
+
+		pipeSet(pipe, block, PIPE_PROCESSED);
+
+		uint64_t done = (uint64_t) (block * pipe->blockRows + rows) * pipe->rowBytes;
+		if(pipe->file->control != NULL && !jobCheck(pipe->file->control, done)){
+			pipeFail(pipe, pipe->file->control->status == JOB_DEADLINE_PASSED ? JOB_DEADLINE_ERROR : JOB_CANCELLED_ERROR);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int pipeFile(BMP_FILE* file, char* fname, uint8_t* buffer, unsigned int start, unsigned int length){
+	PIPE pipe;
+	struct stat info;
+	pthread_t reader, writer;
+
+	if(file == NULL)
+		return 0;
+
+	if(!rangeErrors(file, start, length))
+		return 0;
+
+	memset(&pipe, 0, sizeof(PIPE));
+	pipe.file = file;
+	pipe.input = fileno(file->fileHandle);
+	pipe.buffer = buffer;
+	pipe.start = start;
+	pipe.end = start + length;
+	pipe.rowBytes = file->width * 3;
+	pipe.stride = pipe.rowBytes + file->padding;
+	pipe.blockRows = PIPE_BLOCK / pipe.stride > 0 ? PIPE_BLOCK / pipe.stride : 1;
+	pipe.blocks = (file->height + pipe.blockRows - 1) / pipe.blockRows;
+
+	off_t dataEnd = file->offset + (off_t) file->height * pipe.stride;
+	if(fstat(pipe.input, &info) != 0 || info.st_size < dataEnd){
+		NOT_VALID_ERROR(file);
+	}
+
+	//A cloned file shares the extents of the original, so only the
+	//replaced rows are written.
+	if((pipe.output = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0){
+		FILE_WRITING_ERROR(file);
+	}
+	if(cloneFile(pipe.input, pipe.output)){
+		int success = writeRows(file, pipe.output, buffer, start, length);
+		if(success && file->dropCache)
+			dropPages(pipe.output, 0, 0, 1);
+		if(file->dropCache)
+			dropPages(pipe.input, 0, 0, 0);
+
+		if(close(pipe.output) != 0 && success){
+			file->error = FILE_WRITING_ERROR;
+			success = 0;
+		}
+		if(!success){
+			remove(fname);
+			return 0;
+		}
+		file->error = NO_ERROR;
+		return 1;
+	}
+
+	for(int i = 0; i < PIPE_SLOTS; i++)
+		if((pipe.slots[i] = malloc((size_t) pipe.blockRows * pipe.stride)) == NULL){
+			close(pipe.output);
+			remove(fname);
+			for(int j = 0; j < i; j++)
+				free(pipe.slots[j]);
+			MEMORY_ALLOCATION_ERROR(file);
+		}
+
+	//The headers and the bytes after the data are copied as is,
+	//before the stages start using the blocks.
+	int success = pipeCopy(&pipe, 0, file->offset) && pipeCopy(&pipe, dataEnd, info.st_size);
+	pipe.error = FILE_WRITING_ERROR;
+
+	if(success){
+		pthread_mutex_init(&pipe.lock, NULL);
+		pthread_cond_init(&pipe.changed, NULL);
+
+		if(pthread_create(&reader, NULL, pipeReader, &pipe) != 0){
+			pipe.error = MEMORY_ALLOCATION_ERROR;
+			success = 0;
+		}
+		else if(pthread_create(&writer, NULL, pipeWriter, &pipe) != 0){
+			pipeFail(&pipe, MEMORY_ALLOCATION_ERROR);
+			pthread_join(reader, NULL);
+			success = 0;
+		}
+		else{
+			success = pipeProcess(&pipe);
+			pthread_join(reader, NULL);
+			pthread_join(writer, NULL);
+			success = success && !pipe.failed;
+		}
+		pthread_mutex_destroy(&pipe.lock);
+		pthread_cond_destroy(&pipe.changed);
+	}
+
+	//The blocks are dropped while reading, but the readahead of the
+	//kernel and the headers are not, so the whole input is dropped.
+	if(success && file->dropCache)
+		dropPages(pipe.output, 0, 0, 1);
+	if(file->dropCache)
+		dropPages(pipe.input, 0, 0, 0);
+	if(close(pipe.output) != 0 && success){
+		pipe.error = FILE_WRITING_ERROR;
+		success = 0;
+	}
+	for(int i = 0; i < PIPE_SLOTS; i++)
+		free(pipe.slots[i]);
+
+	if(!success){
+		remove(fname);
+		file->error = pipe.error;
+		return 0;
+	}
+	file->error = NO_ERROR;
+	return 1;
+}
+
+//Copies the bytes of the original file after the data to the output.
+static int copyTail(BMP_FILE* file, FILE* output){
+	uint8_t buffer[1 << 16];
+	size_t amount;
+
+	if(fseeko(file->fileHandle, file->offset + (off_t) file->height * (file->width * 3 + file->padding), SEEK_SET) != 0){
+		NOT_VALID_ERROR(file);
+	}
+	while((amount = fread(buffer, 1, sizeof(buffer), file->fileHandle)) > 0)
+		if(fwrite(buffer, 1, amount, output) != amount){
+			FILE_WRITING_ERROR(file);
+		}
+	if(ferror(file->fileHandle)){
+		NOT_VALID_ERROR(file);
+	}
+	return 1;
+}
+
 int writeToFile(BMP_FILE* file, char* fname){
 	FILE* output;
-	int read, index = 0;
+	int read;
 	
 	if(file == NULL)
 		return 0;
@@ -173,6 +898,14 @@ int writeToFile(BMP_FILE* file, char* fname){
 	if(file->fileHandle == NULL){
 		NULL_FILE_ERROR(file);
 	}
+
+	//When the changed part of the data is known, only it is written
+	//over a copy of the original file. Decompressed bitmaps need a
+	//new header and data, so they are always written whole.
+	if(file->changedKnown && !file->headerChanged && file->data != NULL
+		&& file->changedStart <= file->changedEnd && file->changedEnd <= dataSize(file))
+		return writeCopy(file, fname, &file->data[file->changedStart], file->changedStart,
+			file->changedEnd - file->changedStart);
 	if((output = fopen(fname, "w+b")) == NULL){
 		FILE_WRITING_ERROR(file);
 	}
@@ -183,8 +916,16 @@ int writeToFile(BMP_FILE* file, char* fname){
 	The header is copied straight from the original file.
 	This way we don't need to worry about the validity of
 	the header if it has been changed.
+	Only decompressed bitmaps get a new header.
+	Everything before the data is copied, also the palette
+	and any gap before the data, so that the data offset in
+	the header stays valid.
 	*/
-	for(unsigned int i = 0; i < 14 + file->hSize; i++){
+	if(file->headerChanged && !writeHeader(file, output)){
+		fclose(output);
+		FILE_WRITING_ERROR(file);
+	}
+	for(unsigned int i = 0; !file->headerChanged && i < file->offset; i++){
 		read = fgetc(file->fileHandle);
 		if(read == EOF){
 			NOT_VALID_ERROR(file);
@@ -194,25 +935,227 @@ int writeToFile(BMP_FILE* file, char* fname){
 		}
 	}
 
+	unsigned int rowBytes = file->width * 3;
+	uint8_t padding[4];
+
+	off_t started = 0, dropped = 0;
+
+	memset(padding, file->padder, sizeof(padding));
+	jobStart(file->control, dataSize(file));
+
 	for(int i = 0; i < file->height; i++){
-		for(int j = 0; j < file->width * 3; j++){
-			//writes the current line of data to the file.
-			if(fputc(file->data[index], output) == EOF){
-				FILE_WRITING_ERROR(file);
-			}
-			index++;
+		//The padding bytes of the original are kept as they are.
+		off_t position = file->offset + (off_t) i * (rowBytes + file->padding) + rowBytes;
+		if(!file->headerChanged && file->padding > 0 &&
+			pread(fileno(file->fileHandle), padding, file->padding, position) != (ssize_t) file->padding){
+			fclose(output);
+			NOT_VALID_ERROR(file);
 		}
-		//Writes the padding bytes
-		for(int j = 0; j < file->padding; j++)
-			if(fputc(file->padder, output) == EOF){
+
+		//Writes the current line of data and the padding bytes.
+		if(fwrite(&file->data[(size_t) i * rowBytes], 1, rowBytes, output) != rowBytes ||
+			fwrite(padding, 1, file->padding, output) != file->padding){
+			fclose(output);
+			FILE_WRITING_ERROR(file);
+		}
+		if(file->rowWritten != NULL)
+			file->rowWritten(file->rowContext, (unsigned int) i * rowBytes, &file->data[(size_t) i * rowBytes], rowBytes);
+		if(file->dropCache && ftello(output) - started >= DROP_CHUNK){
+			if(fflush(output) != 0){
+				fclose(output);
 				FILE_WRITING_ERROR(file);
 			}
+			writeBehind(fileno(output), &started, &dropped, ftello(output));
+		}
+		if(file->control != NULL && !jobCheck(file->control, (uint64_t) (i + 1) * rowBytes)){
+			fclose(output);
+			remove(fname);
+			JOB_STOPPED_ERROR(file);
+		}
+	}
+	//The bytes after the data are copied as they are.
+	if(!file->headerChanged && !copyTail(file, output)){
+		fclose(output);
+		remove(fname);
+		return 0;
+	}
+	if(file->dropCache && fflush(output) == 0){
+		dropPages(fileno(output), 0, 0, 1);
+		dropPages(fileno(file->fileHandle), 0, 0, 0);
+	}
+	if(fclose(output) != 0){
+		FILE_WRITING_ERROR(file);
 	}
-	fclose(output);
 	file->error = NO_ERROR;
 	return 1;
 }
 
+uint64_t parseFootprint(BMP_FILE* file){
+	uint64_t data = dataSize(file);
+
+	if(file->compression != BI_RLE8 && file->compression != BI_RLE4)
+		return data;
+
+	//The compressed data and a palette index for each pixel are
+	//held together with the decompressed data.
+	uint64_t size = file->imgSize;
+	if(size == 0)
+		size = file->fSize > file->offset ? file->fSize - file->offset : 0;
+
+	return size + 1 + data / 3 + data;
+}
+
 unsigned int dataSize(BMP_FILE* file){
-	return file->imgSize - file->height * file->padding;
+	//Counted from the dimensions, since the image size in
+	//the header is allowed to be 0 for uncompressed bitmaps.
+	if(file->width <= 0 || file->height <= 0)
+		return 0;
+
+	uint64_t size = (uint64_t) file->width * 3 * (uint64_t) file->height;
+	return size <= UINT32_MAX ? (unsigned int) size : 0;
+}
+
+int probeBmp(char* fileName, BMP_INFO* info){
+	uint8_t buffer[54];
+	int fd;
+
+	memset(info, 0, sizeof(BMP_INFO));
+
+	if((fd = open(fileName, O_RDONLY)) < 0){
+		info->error = NULL_FILE_ERROR;
+		return 0;
+	}
+	ssize_t read = pread(fd, buffer, sizeof(buffer), 0);
+	struct stat file;
+	if(fstat(fd, &file) != 0)
+		read = 0;
+	close(fd);
+
+	//The fields used are the same as the ones parseHeader() reads.
+	if(read < 38 || buffer[0] != 0x42 || buffer[1] != 0x4D){
+		info->error = NOT_VALID_BITMAP_ERROR;
+		return 0;
+	}
+
+	info->fSize 	  = toUInt(&buffer[2]);
+	info->offset 	  = toUInt(&buffer[10]);
+	info->hSize 	  = toUInt(&buffer[14]);
+	info->width 	  = toUInt(&buffer[18]);
+	info->height 	  = toUInt(&buffer[22]);
+	info->bpp 		  = toUShort(&buffer[28]);
+	info->compression = toUInt(&buffer[30]);
+	info->imgSize 	  = toUInt(&buffer[34]);
+
+	if(info->width > 0 && info->bpp > 0)
+		info->rowStride = (((uint32_t) info->width * info->bpp + 31) / 32) * 4;
+
+	info->supported = info->width > 0 && info->height > 0 &&
+		((info->bpp == 24 && info->compression == BI_RGB) ||
+		 (info->bpp == 8 && info->compression == BI_RLE8) ||
+		 (info->bpp == 4 && info->compression == BI_RLE4)) &&
+		sizeFits(info->width, info->height, info->bpp, info->compression, info->offset, file.st_size);
+
+	//The data of compressed bitmaps is decompressed to 24 bpp.
+	if(info->supported)
+		info->dataSize = (uint32_t) info->width * 3 * (uint32_t) info->height;
+
+	info->error = NO_ERROR;
+	return 1;
+}
+
+//Checks that the given data range can be accessed straight from the file.
+static int rangeErrors(BMP_FILE* file, unsigned int start, unsigned int length){
+	if(file->headerParsed != 1){
+		HEADER_NOT_PARSED_ERROR(file);
+	}
+	if(file->fileHandle == NULL){
+		NULL_FILE_ERROR(file);
+	}
+	if(file->bpp != 24 || file->compression != BI_RGB || file->headerChanged
+		|| file->width <= 0 || file->height <= 0){
+		NOT_VALID_ERROR(file);
+	}
+	if(start > dataSize(file) || length > dataSize(file) - start){
+		NOT_VALID_ERROR(file);
+	}
+	return 1;
+}
+
+int readDataRange(BMP_FILE* file, uint8_t* buffer, unsigned int start, unsigned int length){
+	if(file == NULL)
+		return 0;
+
+	if(!rangeErrors(file, start, length))
+		return 0;
+
+	unsigned int rowBytes = file->width * 3;
+
+	//The range is read one row at a time, skipping the padding. The
+	//reads do not go through the stdio buffer, so only the pages
+	//holding the range are read. When the pages are dropped the
+	//kernel is told not to read ahead, since pages still being read
+	//ahead could not be dropped.
+	if(file->dropCache)
+		posix_fadvise(fileno(file->fileHandle), 0, 0, POSIX_FADV_RANDOM);
+
+	unsigned int total = length;
+	int stopped = 0;
+	jobStart(file->control, total);
+
+	while(length > 0){
+		unsigned int row = start / rowBytes,
+					 column = start % rowBytes,
+					 amount = rowBytes - column;
+		if(amount > length)
+			amount = length;
+
+		off_t position = file->offset + (off_t) row * (rowBytes + file->padding) + column;
+		if(pread(fileno(file->fileHandle), buffer, amount, position) != (ssize_t) amount)
+			break;
+		buffer += amount;
+		start += amount;
+		length -= amount;
+
+		if(file->control != NULL && !jobCheck(file->control, total - length)){
+			stopped = 1;
+			break;
+		}
+	}
+
+	//The whole file is dropped once the range has been read, so that
+	//the partial pages and the headers are dropped too.
+	if(file->dropCache)
+		dropPages(fileno(file->fileHandle), 0, 0, 0);
+	if(stopped){
+		JOB_STOPPED_ERROR(file);
+	}
+	if(length > 0){
+		NOT_VALID_ERROR(file);
+	}
+	file->error = NO_ERROR;
+	return 1;
+}
+
+int writeDataRange(BMP_FILE* file, uint8_t* buffer, unsigned int start, unsigned int length){
+	if(file == NULL)
+		return 0;
+
+	if(!rangeErrors(file, start, length))
+		return 0;
+
+	//The range is written whole or not at all, so the job is checked
+	//before writing.
+	jobStart(file->control, length);
+	if(file->control != NULL && !jobCheck(file->control, length)){
+		JOB_STOPPED_ERROR(file);
+	}
+
+	//Anything buffered by stdio is written before writing past it.
+	if(fflush(file->fileHandle) != 0 || !writeRows(file, fileno(file->fileHandle), buffer, start, length)){
+		FILE_WRITING_ERROR(file);
+	}
+	if(file->dropCache)
+		dropPages(fileno(file->fileHandle), 0, 0, 1);
+	file->error = NO_ERROR;
+	return 1;
 }
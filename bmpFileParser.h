@@ -12,13 +12,22 @@ Functions:
 	int parseHeader(BMP_FILE*)
 	int parseData(BMP_FILE*)
 	int writeToFile(BMP_FILE*, char*)
+	void markChanged(BMP_FILE*, unsigned int, unsigned int)
+	int writeRangeToFile(BMP_FILE*, char*, uint8_t*, unsigned int, unsigned int)
+	int pipeFile(BMP_FILE*, char*, uint8_t*, unsigned int, unsigned int)
+	uint64_t parseFootprint(BMP_FILE*)
 	unsigned int dataSize(BMP_FILE*)
+	int readDataRange(BMP_FILE*, uint8_t*, unsigned int, unsigned int)
+	int writeDataRange(BMP_FILE*, uint8_t*, unsigned int, unsigned int)
+	int probeBmp(char*, BMP_INFO*)
 
 Dependancies:
 	Uses the functions:
 		unsigned int toInteger(byte*)
 	    unsigned short toShort(byte*)
 	    from the bitModul-library.
+	Uses the jobControl modul.
+	Uses POSIX threads.
 */
 
 #define NOT_VALID_ERROR(p)\
@@ -45,6 +54,15 @@ Dependancies:
 		p->error = HEADER_NOT_PARSED;\
 		return 0
 
+#define JOB_STOPPED_ERROR(p)\
+		p->error = p->control->status == JOB_DEADLINE_PASSED ? JOB_DEADLINE_ERROR : JOB_CANCELLED_ERROR;\
+		return 0
+
+//The compression values supported by this modul.
+#define BI_RGB 0
+#define BI_RLE8 1
+#define BI_RLE4 2
+
 /********************************************
 Enum: ERROR_NO
 
@@ -63,7 +81,9 @@ typedef enum{
 	UNSUPPORTED_MEMORY_FORMAT_ERROR,//The memory format in this machine is invalid
 	MEMORY_ALLOCATION_ERROR,		//A malloc operatio returnes NULL
 	FILE_WRITING_ERROR,				//There was an error while writing to a file
-	HEADER_NOT_PARSED				//The header needs to be parsed for this function
+	HEADER_NOT_PARSED,				//The header needs to be parsed for this function
+	JOB_CANCELLED_ERROR,			//The job controlling the struct was cancelled
+	JOB_DEADLINE_ERROR				//The deadline of the job controlling the struct passed
 }ERROR_NO;
 
 /********************************************
@@ -81,6 +101,22 @@ Usage: You should not create these structs manually. Instead you should
        use only the functions provided within this module.
        Also changing these values at runtime can lead into some unwanted 
        functionality 
+       The control variable is the exception: it can be set to a
+       JOB_CONTROL struct (see the jobControl modul) to make the
+       parseData() and the writeToFile()-functions stop when the
+       job is cancelled or its deadline passes.
+       The rowRead and rowContext variables can also be set: the
+       parseData()-function gives each row to the rowRead callback
+       right after reading it, while it is still in the cache, e.g.
+       for hashing the data without reading it again. In the same
+       way the writing functions give the data bytes they write to
+       the rowWritten callback, together with the position of the
+       first byte in the data.
+       Setting the dropCache variable to 1 keeps the file from
+       filling the page cache: the pages read and written are
+       dropped from the cache as the work proceeds (written pages
+       are passed to the disk first), so that handling large files
+       does not push the data of other programs out of the memory.
 ********************************************/
 typedef struct{
 	uint32_t fSize;      	//The file size of this bitmap
@@ -92,16 +128,53 @@ typedef struct{
 	int32_t  width;			//The width of this bitmap
 	int32_t  height;		//The height of this bitmap
 
+	uint32_t colors;		//The amount of colours in the palette, 0 for the maximum
+
 	uint8_t padder;			//The byte used for padding by this bitmap
 	uint16_t padding; 		//The amount of padding bytes used in this bitmap
 	int headerParsed;		//Is 1 if the header has been parsed 0 otherwise
+	int headerChanged;		//Is 1 if the data no longer matches the header in the file
+	int changedKnown;		//Is 1 if only the data bytes marked changed differ from the file
+	unsigned int changedStart;	//The first changed data byte
+	unsigned int changedEnd;	//The end of the changed data bytes
 
 	uint8_t* data;			//The bitmap data of this bitmap
 	
 	ERROR_NO error;			//The error in this bitmap
 	FILE* fileHandle;		//The file handle of this bitmap
+
+	struct JOB_CONTROL* control;	//The job checked while parsing and writing the data, or NULL
+	void (*rowRead)(void* context, const uint8_t* row, unsigned int length);	//Called for each parsed row, or NULL
+	void (*rowWritten)(void* context, unsigned int start, const uint8_t* bytes, unsigned int length);	//Called for each written piece of data, or NULL
+	void* rowContext;				//Given to the rowRead and the rowWritten callbacks
+	int dropCache;					//Is 1 if the pages read and written should be dropped from the page cache
 }BMP_FILE;
 
+/********************************************
+Struct: BMP_INFO
+
+Purpose: Holds the header values of a bitmap file as read
+	 by the probeBmp()-function. Unlike BMP_FILE this struct
+	 is not connected to an open file, so it can be used for
+	 looking at large amounts of files quickly.
+********************************************/
+typedef struct{
+	uint32_t fSize;      	//The file size of this bitmap
+	uint32_t offset;     	//The start of the bitmap data
+	uint32_t hSize;  	 	//The size of the file header of this bitmap
+	uint32_t imgSize;	 	//The size of the bitmap data
+	int16_t  bpp;	 		//The amount of bits per pixel in this bitmap
+	uint32_t compression; 	//The compression used in this bitmap
+	int32_t  width;			//The width of this bitmap
+	int32_t  height;		//The height of this bitmap
+
+	uint32_t rowStride;		//The bytes in each uncompressed row, padding included
+	int supported;			//Is 1 if parseData() supports this bitmap
+	uint32_t dataSize;		//The size of the data area parseData() would fill
+
+	ERROR_NO error;			//The error while probing
+}BMP_INFO;
+
 /********************************************
 Function: skipBytes(FILE*, unsigned int)
 
@@ -219,7 +292,9 @@ Modifies: Overwrites the current values in the given struct.
 Error checking: Reports of an error if:
 		the file handle in the struct is NULL,
 		the memory format of the current machine is invalid,
-		the file in the struct does is not a valid bitmap file.
+		the file in the struct does is not a valid bitmap file,
+		the data would not fit in 32 bits,
+		the uncompressed data does not fit in the file.
 
 Sample call: if(parseHeader(file))
 		...success...
@@ -235,7 +310,17 @@ Purpose: Parses the bitmap data from the file in
 	 the given struct to the struct.
 	 The possible padding bytes in the file 
 	 will be removed.
-	 This function only works for 24 bpp bitmaps.
+	 This function works for uncompressed 24 bpp bitmaps
+	 and for 8 bpp and 4 bpp bitmaps compressed with
+	 BI_RLE8 or BI_RLE4.
+	 Compressed bitmaps are decompressed and their colours
+	 are looked up from the palette, so the data will
+	 allways be in the 24 bpp format. The values in the
+	 struct are changed to describe the uncompressed 24 bpp
+	 bitmap and writeToFile() will write such a bitmap.
+	 If the rowRead variable of the struct is set, each row
+	 of the data is given to it in order once it has been
+	 parsed.
 
 Inputs: A pointer the struct to wich the parsing should 
 	be done.
@@ -252,11 +337,15 @@ Modifies: Frees the previous area pointed by the structs
 
 Error checking: Reports an error if:
 		the given struct was NULL,
-		the bpp of the file is not 24,
+		the bpp and compression of the file are not supported,
 		the header for the given struct has not been parsed,
 		the file handle in the struct is NULL,
 		the memory allocation for the file data was unsuccessfull,
-		the file in the struct is not a valid bitmap file.
+		the file in the struct is not a valid bitmap file,
+		the compressed data has runs outside of the bitmap,
+		the job in the control variable was stopped.
+		The data parsed before the job was stopped is left
+		in the struct, the job tells how much was parsed.
 
 Sample call: if(parseData(file))
 		...success...
@@ -272,6 +361,16 @@ Purpose: Writes the given BMP_FILE struct to the
 	 file specified by the given filepath.
 	 Changes to the files header data WILL NOT BE 
 	 SAVED, only changes in the data.
+	 For bitmaps decompressed by parseData() a new
+	 header for an uncompressed 24 bpp bitmap is written.
+	 If the changed part of the data has been told with the
+	 markChanged()-function, the original file is copied
+	 with copy_file_range() (or cloned, sharing its extents
+	 on filesystems like XFS and btrfs) and only the changed
+	 part is written over the copy. Otherwise the whole file
+	 is written.
+	 The data bytes written are given to the rowWritten
+	 callback of the struct, if it is set.
 
 Inputs: A BMP_FILE struct to be written.
 	A string specifying the file path where to write.
@@ -291,7 +390,9 @@ Error checking: Reports an error if:
 		the file specified by the given path could not be opened,
 		the file in the given struct was NULL,
 		the file in the given struct is not a valid bitmap file,
-		there was an error when writing to the new file
+		there was an error when writing to the new file,
+		the job in the control variable was stopped, in wich
+		case the partially written file is removed.
 
 Sample call: if(writeToFile(file, "new filepath"))
 		...success...
@@ -300,6 +401,143 @@ Sample call: if(writeToFile(file, "new filepath"))
 ********************************************/
 int writeToFile(BMP_FILE*, char*);
 
+/********************************************
+Function: markChanged(BMP_FILE*, unsigned int, unsigned int)
+
+Purpose: Tells the struct that the data bytes in the given
+	 range have been changed since parseData(). If all the
+	 changes have been marked, writeToFile() writes only
+	 the changed part over a copy of the original file.
+	 Without any marks the whole data is written.
+
+Inputs: The BMP_FILE, the index of the first changed data
+	byte and the amount of changed bytes. Several ranges
+	can be marked, the data between them is then written
+	too.
+
+Returns: Nothing.
+
+Modifies: The changed range of the struct. parseData()
+	  clears it.
+
+Error checking: None.
+
+Sample call: embedPayload(file->data, dataSize(file), msg, len, &info);
+	     markChanged(file, 0, payloadAreaSize(len, &info));
+********************************************/
+void markChanged(BMP_FILE*, unsigned int, unsigned int);
+
+/********************************************
+Function: writeRangeToFile(BMP_FILE*, char*, uint8_t*, unsigned int, unsigned int)
+
+Purpose: Writes a copy of the file of the given struct to the
+	 given path, with a part of the data replaced by the
+	 given buffer. The data of the struct does not need to
+	 be parsed, so a bitmap of any size can be encoded with
+	 only the changed part in memory.
+	 The file is copied the same way as writeToFile() copies
+	 it, with a plain copy as the last resort.
+
+Inputs: The BMP_FILE, the path of the new file, the new data, the
+	index of the first data byte replaced and the amount of
+	data bytes replaced.
+	The header of the struct must have been parsed. The given
+	path MUST NOT BE THE SAME as with the file in the struct.
+
+Returns: 1 on success 0 otherwise.
+	 If 0 was returned a more specific description of
+	 the error can be obtained from the error variable
+	 in the given struct.
+
+Modifies: Overwites the file specified by the given filepath.
+
+Error checking: Reports an error if:
+		the header for the given struct has not been parsed,
+		the bitmap in the file is not an uncompressed 24 bpp bitmap,
+		the range is outside of the data area,
+		there was an error while writing the new file,
+		the job in the control variable was stopped.
+		The new file is removed on failure.
+
+Sample call: readDataRange(file, window, 0, size);
+	     ...change the window...
+	     if(!writeRangeToFile(file, "new filepath", window, 0, size))
+		...failure...
+********************************************/
+int writeRangeToFile(BMP_FILE*, char*, uint8_t*, unsigned int, unsigned int);
+
+/********************************************
+Function: pipeFile(BMP_FILE*, char*, uint8_t*, unsigned int, unsigned int)
+
+Purpose: Writes a copy of the file of the given struct to the
+	 given path, with a part of the data replaced by the
+	 given buffer, like the writeRangeToFile()-function.
+	 The copy shares the extents of the original on
+	 filesystems supporting it, and then only the replaced
+	 rows are written. Otherwise the data is piped through
+	 memory without holding it whole: a reader thread reads
+	 blocks of rows to a ring of PIPE_SLOTS blocks, the
+	 calling thread patches the replaced bytes into them and
+	 a writer thread writes them, all three at the same
+	 time. This way copying a large bitmap takes about as
+	 long as the slower of reading and writing it, and the
+	 memory used is a few blocks of PIPE_BLOCK bytes
+	 whatever the size of the bitmap. The headers and the
+	 bytes after the data are copied as is.
+
+Inputs: The BMP_FILE, the path of the new file, the new data, the
+	index of the first data byte replaced and the amount of
+	data bytes replaced.
+	The header of the struct must have been parsed, the data
+	does not need to be parsed. The given path MUST NOT BE
+	THE SAME as with the file in the struct.
+
+Returns: 1 on success 0 otherwise.
+	 If 0 was returned a more specific description of
+	 the error can be obtained from the error variable
+	 in the given struct.
+
+Modifies: Overwites the file specified by the given filepath.
+	  The replaced rows are given to the rowWritten callback
+	  of the struct, when piping from the writer thread.
+
+Error checking: Reports an error if:
+		the header for the given struct has not been parsed,
+		the bitmap in the file is not an uncompressed 24 bpp bitmap,
+		the range is outside of the data area,
+		the file is truncated,
+		there was not enough memory for the blocks,
+		there was an error while writing the new file,
+		the job in the control variable was stopped.
+		The new file is removed on failure.
+
+Sample call: readDataRange(file, window, 0, size);
+	     ...change the window...
+	     if(!pipeFile(file, "new filepath", window, 0, size))
+		...failure...
+********************************************/
+int pipeFile(BMP_FILE*, char*, uint8_t*, unsigned int, unsigned int);
+
+/********************************************
+Function: parseFootprint(BMP_FILE*)
+
+Purpose: Tells how much memory the parseData()-function
+	 reserves atmost for the given bitmap, so that the
+	 memory can be planned for before parsing.
+
+Inputs: A BMP_FILE wich header has been parsed.
+
+Returns: The amount of bytes.
+
+Modifies: Nothing.
+
+Error checking: None.
+
+Sample call: if(parseFootprint(file) > available)
+		...use readDataRange() instead...
+********************************************/
+uint64_t parseFootprint(BMP_FILE*);
+
 /********************************************
 Function: dataSize(BMP_FILE*)
 
@@ -308,6 +546,8 @@ Purpose: Returns the size of the data memory area
 	 Note though that this function will return
 	 a value even if the data area has not been
 	 reserved.
+	 For compressed bitmaps the value is valid only
+	 after parseData() has been called.
 
 Inputs: The BMP_FILE wich's data area's you want to 
 	know.
@@ -330,3 +570,105 @@ Sample call:
 
 ********************************************/
 unsigned int dataSize(BMP_FILE*);
+
+/********************************************
+Function: readDataRange(BMP_FILE*, uint8_t*, unsigned int, unsigned int)
+
+Purpose: Reads a part of the bitmap data straight from the
+	 file without parsing the whole data.
+	 The range is given as indices of the data area
+	 (as filled by parseData()), the padding bytes of the
+	 file are skipped.
+
+Inputs: The BMP_FILE to read from, a buffer for the data, the
+	index of the first data byte and the amount of data
+	bytes to read.
+	The buffer must have space for the given amount of bytes.
+	The header of the struct must have been parsed.
+
+Returns: 1 on success 0 otherwise.
+	 If 0 was returned a more specific description of
+	 the error can be obtained from the error variable
+	 in the given struct.
+
+Modifies: Overwrites the given buffer.
+	  Moves the file pointer in the given struct.
+
+Error checking: Reports an error if:
+		the header for the given struct has not been parsed,
+		the file handle in the struct is NULL,
+		the bitmap in the file is not an uncompressed 24 bpp bitmap,
+		the range is outside of the data area,
+		the file ended before the range was read,
+		the job in the control variable was stopped.
+
+Sample call: uint8_t headerArea[HEADER_AREA];
+	     if(!readDataRange(file, headerArea, 0, HEADER_AREA))
+		...failure...
+********************************************/
+int readDataRange(BMP_FILE*, uint8_t*, unsigned int, unsigned int);
+
+/********************************************
+Function: writeDataRange(BMP_FILE*, uint8_t*, unsigned int, unsigned int)
+
+Purpose: Writes a part of the bitmap data straight to the file
+	 of the struct, e.g. modifies the file in place.
+	 This is the reverse of the readDataRange()-function.
+
+Inputs: The BMP_FILE to write to, the data to be written, the
+	index of the first data byte and the amount of data
+	bytes to write.
+	The header of the struct must have been parsed.
+
+Returns: 1 on success 0 otherwise.
+	 If 0 was returned a more specific description of
+	 the error can be obtained from the error variable
+	 in the given struct.
+
+Modifies: Overwrites the given range of data in the file of the
+	  struct. The padding bytes of the file are left as they are.
+
+Error checking: Reports an error if:
+		the header for the given struct has not been parsed,
+		the file handle in the struct is NULL,
+		the bitmap in the file is not an uncompressed 24 bpp bitmap,
+		the range is outside of the data area,
+		there was an error while writing to the file,
+		the job in the control variable was stopped before
+		writing, nothing is then written.
+
+Sample call: if(!writeDataRange(file, window, start, end - start))
+		...failure...
+********************************************/
+int writeDataRange(BMP_FILE*, uint8_t*, unsigned int, unsigned int);
+
+/********************************************
+Function: probeBmp(char*, BMP_INFO*)
+
+Purpose: Reads the header values of the given bitmap file
+	 without opening a BMP_FILE struct for it. The fixed
+	 part of the header is read with a single read call to
+	 a buffer on the stack, nothing is allocated.
+	 This is meant for planning work on large amounts of
+	 files.
+
+Inputs: The path of the file and the struct where the values
+	should be stored.
+
+Returns: 1 on success 0 otherwise.
+	 If 0 was returned the error variable of the given
+	 struct tells the reason.
+
+Modifies: Overwrites the given struct.
+
+Error checking: Reports an error if:
+		the file could not be opened,
+		the file does not start like a bitmap file.
+		Unsupported bitmaps are not an error, the supported
+		variable of the struct tells if the bitmap is supported.
+
+Sample call: BMP_INFO info;
+	     if(probeBmp("filepath", &info) && info.supported)
+		...capacity = payloadCapacity(info.dataSize, &options)...
+********************************************/
+int probeBmp(char*, BMP_INFO*);
@@ -0,0 +1,213 @@
+#include <string.h>
+#include "checksum.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define HARDWARE_CRC
+#endif
+
+//The reversed Castagnoli polynomial
+#define POLYNOMIAL 0x82F63B78
+
+static uint32_t table[8][256];
+static int initialized = 0;
+
+static uint32_t crcTable(uint32_t, const uint8_t*, size_t);
+#ifdef HARDWARE_CRC
+__attribute__((target("sse4.2")))
+static uint32_t crcHardware(uint32_t, const uint8_t*, size_t);
+#endif
+//The implementation chosen by crcInit.
+static uint32_t (*crcMethod)(uint32_t, const uint8_t*, size_t) = crcTable;
+
+void crcInit(){
+	if(initialized)
+		return;
+
+	for(int i = 0; i < 256; i++){
+		uint32_t c = i;
+		for(int j = 0; j < 8; j++)
+			c = (c & 1) ? (c >> 1) ^ POLYNOMIAL : c >> 1;
+		table[0][i] = c;
+	}
+	//Table k tells the effect of a byte followed by k zero bytes.
+	for(int k = 1; k < 8; k++)
+		for(int i = 0; i < 256; i++)
+			table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+
+#ifdef HARDWARE_CRC
+	if(__builtin_cpu_supports("sse4.2"))
+		crcMethod = crcHardware;
+#endif
+
+	initialized = 1;
+}
+
+static uint32_t crcTable(uint32_t crc, const uint8_t* data, size_t length){
+	//Slicing-by-8: eight bytes are handled with eight independent lookups.
+	for(; length >= 8; length -= 8, data += 8){
+		uint32_t low = crc ^ ((uint32_t) data[0] | (uint32_t) data[1] << 8 |
+						(uint32_t) data[2] << 16 | (uint32_t) data[3] << 24),
+				 high = (uint32_t) data[4] | (uint32_t) data[5] << 8 |
+						(uint32_t) data[6] << 16 | (uint32_t) data[7] << 24;
+
+		crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^
+			  table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] ^
+			  table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF] ^
+			  table[1][(high >> 16) & 0xFF] ^ table[0][high >> 24];
+	}
+	while(length--)
+		crc = (crc >> 8) ^ table[0][(crc ^ *data++) & 0xFF];
+
+	return crc;
+}
+
+#ifdef HARDWARE_CRC
+__attribute__((target("sse4.2")))
+static uint32_t crcHardware(uint32_t crc, const uint8_t* data, size_t length){
+	uint64_t c = crc;
+
+	for(; length >= 8; length -= 8, data += 8){
+		uint64_t v;
+		memcpy(&v, data, 8);
+		c = _mm_crc32_u64(c, v);
+	}
+	crc = (uint32_t) c;
+	while(length--)
+		crc = _mm_crc32_u8(crc, *data++);
+
+	return crc;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const uint8_t* data, size_t length){
+	crcInit();
+	return ~crcMethod(~crc, data, length);
+}
+
+//The primes of the XXH64 hash.
+#define PRIME1 11400714785074694791ULL
+#define PRIME2 14029467366897019727ULL
+#define PRIME3 1609587929392839161ULL
+#define PRIME4 9650029242287828579ULL
+#define PRIME5 2870177450012600261ULL
+
+//On little endian processors the data can be loaded as is.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define LITTLE_ENDIAN_HOST
+#endif
+
+static uint64_t rotate(uint64_t x, int r){
+	return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read64(const uint8_t* p){
+#ifdef LITTLE_ENDIAN_HOST
+	uint64_t v;
+	memcpy(&v, p, 8);
+	return v;
+#else
+	return (uint64_t) p[0] | (uint64_t) p[1] << 8 | (uint64_t) p[2] << 16 | (uint64_t) p[3] << 24 |
+		(uint64_t) p[4] << 32 | (uint64_t) p[5] << 40 | (uint64_t) p[6] << 48 | (uint64_t) p[7] << 56;
+#endif
+}
+
+static uint64_t read32(const uint8_t* p){
+	return (uint64_t) p[0] | (uint64_t) p[1] << 8 | (uint64_t) p[2] << 16 | (uint64_t) p[3] << 24;
+}
+
+static uint64_t hashRound(uint64_t acc, uint64_t input){
+	return rotate(acc + input * PRIME2, 31) * PRIME1;
+}
+
+static uint64_t hashMerge(uint64_t acc, uint64_t value){
+	return (acc ^ hashRound(0, value)) * PRIME1 + PRIME4;
+}
+
+void hashInit(HASH_STATE* state, uint64_t seed){
+	memset(state, 0, sizeof(HASH_STATE));
+	state->seed = seed;
+	state->acc[0] = seed + PRIME1 + PRIME2;
+	state->acc[1] = seed + PRIME2;
+	state->acc[2] = seed;
+	state->acc[3] = seed - PRIME1;
+}
+
+void hashUpdate(HASH_STATE* state, const uint8_t* data, size_t length){
+	state->total += length;
+
+	//A stripe left incomplete by the previous piece is filled first.
+	if(state->buffered > 0){
+		size_t fill = 32 - state->buffered < length ? 32 - state->buffered : length;
+
+		memcpy(&state->buffer[state->buffered], data, fill);
+		state->buffered += fill;
+		data += fill;
+		length -= fill;
+		if(state->buffered < 32)
+			return;
+
+		for(int i = 0; i < 4; i++)
+			state->acc[i] = hashRound(state->acc[i], read64(&state->buffer[i * 8]));
+		state->buffered = 0;
+	}
+
+	//The rounds of the main loop are written out, so that they are
+	//fast also when the compiler does not inline the functions.
+	uint64_t a = state->acc[0], b = state->acc[1], c = state->acc[2], d = state->acc[3], v[4];
+	for(; length >= 32; length -= 32, data += 32){
+#ifdef LITTLE_ENDIAN_HOST
+		memcpy(v, data, 32);
+#else
+		for(int i = 0; i < 4; i++)
+			v[i] = read64(data + 8 * i);
+#endif
+		a += v[0] * PRIME2;
+		b += v[1] * PRIME2;
+		c += v[2] * PRIME2;
+		d += v[3] * PRIME2;
+		a = ((a << 31) | (a >> 33)) * PRIME1;
+		b = ((b << 31) | (b >> 33)) * PRIME1;
+		c = ((c << 31) | (c >> 33)) * PRIME1;
+		d = ((d << 31) | (d >> 33)) * PRIME1;
+	}
+	state->acc[0] = a;
+	state->acc[1] = b;
+	state->acc[2] = c;
+	state->acc[3] = d;
+
+	memcpy(state->buffer, data, length);
+	state->buffered = length;
+}
+
+uint64_t hashFinal(const HASH_STATE* state){
+	const uint8_t* p = state->buffer;
+	size_t left = state->buffered;
+	uint64_t h;
+
+	if(state->total >= 32){
+		h = rotate(state->acc[0], 1) + rotate(state->acc[1], 7) + rotate(state->acc[2], 12) + rotate(state->acc[3], 18);
+		for(int i = 0; i < 4; i++)
+			h = hashMerge(h, state->acc[i]);
+	}
+	else
+		h = state->seed + PRIME5;
+	h += state->total;
+
+	for(; left >= 8; left -= 8, p += 8)
+		h = rotate(h ^ hashRound(0, read64(p)), 27) * PRIME1 + PRIME4;
+	if(left >= 4){
+		h = rotate(h ^ read32(p) * PRIME1, 23) * PRIME2 + PRIME3;
+		left -= 4;
+		p += 4;
+	}
+	for(; left > 0; left--, p++)
+		h = rotate(h ^ *p * PRIME5, 11) * PRIME1;
+
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+	return h;
+}
@@ -0,0 +1,143 @@
+#include <stdint.h>
+#include <stddef.h>
+/*
+Purpose:
+	This modul computes CRC32C (Castagnoli) checksums.
+	They are used for telling a valid embedded payload
+	from a damaged or truncated one.
+	On processors supporting SSE4.2 the checksum is
+	computed with the crc32 instruction, otherwise a
+	slicing-by-8 table method is used. Both produce
+	the same checksums.
+	For telling whether data has been seen before this
+	modul also computes the 64 bit XXH64 hash, wich is
+	much faster than the checksum and can be computed
+	piece by piece while the data is being read.
+
+Functions:
+	void crcInit()
+	uint32_t crc32c(uint32_t, const uint8_t*, size_t)
+	void hashInit(HASH_STATE*, uint64_t)
+	void hashUpdate(HASH_STATE*, const uint8_t*, size_t)
+	uint64_t hashFinal(const HASH_STATE*)
+
+Dependancies: None.
+*/
+
+/********************************************
+Function: crcInit()
+
+Purpose: Builds the tables used by the table method and
+	 chooses once the implementation used by crc32c: the
+	 SSE 4.2 instruction when the processor has it, the
+	 tables otherwise.
+
+Inputs: Nothing.
+
+Returns: Nothing.
+
+Modifies: The internal tables and the chosen implementation
+	  of this modul. Calling this
+	  function more than once does nothing.
+	  This function is not thread safe, call it once before
+	  starting any threads.
+
+Error checking: None.
+
+Sample call: crcInit();
+********************************************/
+void crcInit();
+
+/********************************************
+Function: crc32c(uint32_t, const uint8_t*, size_t)
+
+Purpose: Computes the CRC32C checksum of the given data,
+	 continuing from a previous checksum. This way the
+	 checksum of a long data area can be computed piece
+	 by piece.
+
+Inputs: The checksum of the preceding data (0 for the first
+	piece), the data and the lenght of the data.
+
+Returns: The checksum of the preceding data and the given data.
+
+Modifies: Nothing.
+
+Error checking: None.
+
+Sample call: uint32_t crc = crc32c(0, first, firstLenght);
+	     crc = crc32c(crc, second, secondLenght);
+	     crc now equals crc32c(0, firstAndSecond, bothLenghts)
+********************************************/
+uint32_t crc32c(uint32_t, const uint8_t*, size_t);
+
+/********************************************
+Struct: HASH_STATE
+
+Purpose: Holds the state of a hash computed piece by piece.
+
+Usage: You should not change these values manually, use
+       the functions of this modul instead.
+********************************************/
+typedef struct{
+	uint64_t acc[4];		//The four lanes of the hash
+	uint64_t seed;			//The seed given to the hashInit()-function
+	uint64_t total;			//The amount of bytes hashed
+	uint8_t buffer[32];		//The bytes not yet filling a 32 byte stripe
+	size_t buffered;		//The amount of bytes in the buffer
+}HASH_STATE;
+
+/********************************************
+Function: hashInit(HASH_STATE*, uint64_t)
+
+Purpose: Starts computing a hash.
+
+Inputs: The state and the seed of the hash.
+
+Returns: Nothing.
+
+Modifies: Overwrites the given struct.
+
+Error checking: None.
+
+Sample call: HASH_STATE hash;
+	     hashInit(&hash, 0);
+********************************************/
+void hashInit(HASH_STATE*, uint64_t);
+
+/********************************************
+Function: hashUpdate(HASH_STATE*, const uint8_t*, size_t)
+
+Purpose: Adds the given data to the hash. The pieces may
+	 be of any lenght, the hash depends only on the
+	 concatenated data.
+
+Inputs: The state, the data and the lenght of the data.
+
+Returns: Nothing.
+
+Modifies: The state.
+
+Error checking: None.
+
+Sample call: hashUpdate(&hash, row, rowLenght);
+********************************************/
+void hashUpdate(HASH_STATE*, const uint8_t*, size_t);
+
+/********************************************
+Function: hashFinal(const HASH_STATE*)
+
+Purpose: Tells the XXH64 hash of the data added so far. More
+	 data may still be added afterwards.
+
+Inputs: The state.
+
+Returns: The hash.
+
+Modifies: Nothing.
+
+Error checking: None.
+
+Sample call: uint64_t key = hashFinal(&hash);
+********************************************/
+uint64_t hashFinal(const HASH_STATE*);
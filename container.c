@@ -0,0 +1,159 @@
+#include <stdlib.h>
+#include <string.h>
+#include "bitModul.h"
+#include "checksum.h"
+#include "payloadFormat.h"
+#include "container.h"
+
+uint32_t directorySize(uint32_t count){
+	return CONTAINER_DIRECTORY_START + count * CONTAINER_ENTRY_SIZE;
+}
+
+static int validEntry(CONTAINER_ENTRY* entry){
+	size_t nameLength = strlen(entry->name);
+
+	if(nameLength == 0 || nameLength > CONTAINER_NAME_LENGTH)
+		return 0;
+
+	if(entry->codec == CODEC_RAW)
+		return 1;
+
+	return entry->codec == CODEC_FEC && entry->parity >= 2 && entry->parity <= 128 && entry->parity % 2 == 0;
+}
+
+uint8_t* packContainer(CONTAINER* dir, uint8_t** contents, uint32_t* packedLength){
+	if(dir->count > CONTAINER_MAX_ENTRIES){
+		dir->error = CONTAINER_TOO_MANY_ENTRIES;
+		return NULL;
+	}
+
+	uint64_t total = directorySize(dir->count);
+
+	for(uint32_t i = 0; i < dir->count; i++){
+		CONTAINER_ENTRY* entry = &dir->entries[i];
+
+		if(!validEntry(entry) || findEntry(dir, entry->name) != entry){
+			dir->error = CONTAINER_INVALID_ENTRY;
+			return NULL;
+		}
+		entry->offset = (uint32_t) (total - directorySize(dir->count));
+		entry->storedLength = entry->codec == CODEC_FEC ? fecSize(entry->length, entry->parity) : entry->length;
+		entry->checksum = crc32c(0, contents[i], entry->length);
+		entry->corrected = 0;
+		total += entry->storedLength;
+	}
+
+	uint8_t* packed;
+	if(total > UINT32_MAX || (packed = calloc(total, 1)) == NULL){
+		dir->error = CONTAINER_MEMORY_ERROR;
+		return NULL;
+	}
+
+	for(uint32_t i = 0; i < dir->count; i++){
+		CONTAINER_ENTRY* entry = &dir->entries[i];
+		uint8_t* record = &packed[directorySize(i)];
+		uint8_t* stored = &packed[directorySize(dir->count) + entry->offset];
+
+		memcpy(record, entry->name, strlen(entry->name));
+		fromUInt(entry->offset, &record[16]);
+		fromUInt(entry->length, &record[20]);
+		fromUInt(entry->storedLength, &record[24]);
+		record[28] = entry->codec;
+		record[29] = entry->codec == CODEC_FEC ? entry->parity : 0;
+		fromUInt(entry->checksum, &record[32]);
+
+		if(entry->codec == CODEC_FEC)
+			fecEncode(contents[i], entry->length, entry->parity, stored);
+		else
+			memcpy(stored, contents[i], entry->length);
+	}
+	fromUInt(dir->count, &packed[0]);
+	fromUInt(crc32c(0, &packed[CONTAINER_DIRECTORY_START], dir->count * CONTAINER_ENTRY_SIZE), &packed[4]);
+
+	*packedLength = (uint32_t) total;
+	dir->error = CONTAINER_OK;
+	return packed;
+}
+
+int readDirectory(uint8_t* bytes, uint32_t available, CONTAINER* dir){
+	dir->count = 0;
+	dir->error = CONTAINER_INVALID_DIRECTORY;
+
+	if(available < CONTAINER_DIRECTORY_START)
+		return 0;
+
+	uint32_t count = toUInt(&bytes[0]);
+	if(count > CONTAINER_MAX_ENTRIES || available < directorySize(count)
+		|| crc32c(0, &bytes[CONTAINER_DIRECTORY_START], count * CONTAINER_ENTRY_SIZE) != toUInt(&bytes[4]))
+		return 0;
+
+	//The entries are packed one after another.
+	uint32_t next = 0;
+	for(uint32_t i = 0; i < count; i++){
+		CONTAINER_ENTRY* entry = &dir->entries[i];
+		uint8_t* record = &bytes[directorySize(i)];
+
+		memcpy(entry->name, record, CONTAINER_NAME_LENGTH);
+		entry->name[CONTAINER_NAME_LENGTH] = '\0';
+		entry->offset 		= toUInt(&record[16]);
+		entry->length 		= toUInt(&record[20]);
+		entry->storedLength = toUInt(&record[24]);
+		entry->codec 		= record[28];
+		entry->parity 		= record[29];
+		entry->checksum 	= toUInt(&record[32]);
+		entry->corrected 	= 0;
+
+		uint32_t expected = entry->codec == CODEC_FEC ? fecSize(entry->length, entry->parity) : entry->length;
+		if(!validEntry(entry) || entry->offset != next || entry->storedLength != expected
+			|| (uint64_t) next + entry->storedLength > UINT32_MAX)
+			return 0;
+
+		next += entry->storedLength;
+	}
+
+	dir->count = count;
+	dir->error = CONTAINER_OK;
+	return 1;
+}
+
+CONTAINER_ENTRY* findEntry(CONTAINER* dir, char* name){
+	for(uint32_t i = 0; i < dir->count; i++)
+		if(strncmp(dir->entries[i].name, name, CONTAINER_NAME_LENGTH + 1) == 0)
+			return &dir->entries[i];
+
+	return NULL;
+}
+
+uint8_t* unpackEntry(uint8_t* stored, CONTAINER_ENTRY* entry, CONTAINER* dir){
+	uint8_t* contents = malloc(entry->length + 1);
+	uint32_t crc;
+
+	if(contents == NULL){
+		dir->error = CONTAINER_MEMORY_ERROR;
+		return NULL;
+	}
+
+	if(entry->codec == CODEC_FEC){
+		int fixed = fecDecode(stored, entry->length, entry->parity, contents, &crc);
+		if(fixed < 0){
+			free(contents);
+			dir->error = CONTAINER_UNCORRECTABLE;
+			return NULL;
+		}
+		entry->corrected = fixed;
+	}
+	else{
+		memcpy(contents, stored, entry->length);
+		crc = crc32c(0, contents, entry->length);
+	}
+
+	if(crc != entry->checksum){
+		free(contents);
+		dir->error = CONTAINER_CHECKSUM_ERROR;
+		return NULL;
+	}
+
+	contents[entry->length] = '\0';
+	dir->error = CONTAINER_OK;
+	return contents;
+}
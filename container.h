@@ -0,0 +1,228 @@
+#include <stdint.h>
+/*
+Purpose:
+	This modul handles the container format, wich allows
+	several named entries (e.g. a manifest, a signature and
+	a description) to be embedded to the same bitmap.
+	The container is embedded as a headered payload with the
+	PAYLOAD_FLAG_CONTAINER flag. It starts with a directory
+	listing the name, the offset, the lenght and the codec
+	of each entry, followed by the entries themselves.
+
+	A single entry can be extracted by extracting the
+	directory and then only the stored bytes of that entry,
+	so the cost does not depend on the size of the other
+	entries. Because of this the entries are protected with
+	FEC one by one instead of the whole container, and each
+	entry has its own checksum. The directory is only
+	protected by its checksum, it is not FEC-coded.
+
+	The directory is stored as:
+		bytes 0 - 3		the amount of entries
+		bytes 4 - 7		the CRC32C checksum of the entries of the directory
+		bytes 8 - 		CONTAINER_ENTRY_SIZE bytes for each entry:
+			bytes 0 - 15	the name, padded with null-characters
+			bytes 16 - 19	the offset of the entry after the directory
+			bytes 20 - 23	the lenght of the entry
+			bytes 24 - 27	the lenght of the entry after FEC encoding
+			byte  28		the codec of the entry
+			byte  29		the FEC parity of the entry
+			bytes 30 - 31	reserved
+			bytes 32 - 35	the CRC32C checksum of the entry
+	All the values are stored in little endian order.
+
+Functions:
+	uint32_t directorySize(uint32_t)
+	uint8_t* packContainer(CONTAINER*, uint8_t**, uint32_t*)
+	int readDirectory(uint8_t*, uint32_t, CONTAINER*)
+	CONTAINER_ENTRY* findEntry(CONTAINER*, char*)
+	uint8_t* unpackEntry(uint8_t*, CONTAINER_ENTRY*, CONTAINER*)
+
+Dependancies:
+	Uses the bitModul, the checksum and the payloadFormat modul.
+*/
+
+//The longest name an entry can have.
+#define CONTAINER_NAME_LENGTH 16
+
+//The largest amount of entries in a container.
+#define CONTAINER_MAX_ENTRIES 64
+
+//The amount of bytes in the start of the directory.
+#define CONTAINER_DIRECTORY_START 8
+
+//The amount of bytes in the directory for each entry.
+#define CONTAINER_ENTRY_SIZE 36
+
+//The codecs of the entries.
+#define CODEC_RAW 0
+#define CODEC_FEC 1
+
+/********************************************
+Enum: CONTAINER_ERROR
+
+Purpose: The different error conditions the functions
+	 of this modul can run into. The value is stored
+	 to the error variable of the CONTAINER struct
+	 given to the functions.
+********************************************/
+typedef enum{
+	CONTAINER_OK,					//No error
+	CONTAINER_INVALID_DIRECTORY,	//The directory is damaged or not a directory at all
+	CONTAINER_INVALID_ENTRY,		//An entry has an invalid name, codec or parity
+	CONTAINER_TOO_MANY_ENTRIES,		//There are more than CONTAINER_MAX_ENTRIES entries
+	CONTAINER_UNCORRECTABLE,		//The entry had too many errors to be corrected
+	CONTAINER_CHECKSUM_ERROR,		//The entry does not match its checksum
+	CONTAINER_MEMORY_ERROR			//A malloc operation returned NULL
+}CONTAINER_ERROR;
+
+/********************************************
+Struct: CONTAINER_ENTRY
+
+Purpose: Holds the directory values of a single entry.
+
+Usage: Before packing a container set the name, the lenght,
+       the codec and the parity variables, the rest of the
+       variables are filled by the packContainer()-function.
+********************************************/
+typedef struct{
+	char name[CONTAINER_NAME_LENGTH + 1];	//The name of the entry
+	uint32_t offset;						//The first stored byte of the entry after the directory
+	uint32_t length;						//The lenght of the entry in bytes
+	uint32_t storedLength;					//The lenght of the entry after FEC encoding
+	uint8_t  codec;							//CODEC_RAW or CODEC_FEC
+	uint8_t  parity;						//Parity bytes per codeword, used with CODEC_FEC
+	uint32_t checksum;						//The CRC32C checksum of the entry
+	uint32_t corrected;						//The amount of bytes corrected while unpacking
+}CONTAINER_ENTRY;
+
+/********************************************
+Struct: CONTAINER
+
+Purpose: Holds the directory of a container.
+********************************************/
+typedef struct{
+	uint32_t count;									//The amount of entries
+	CONTAINER_ENTRY entries[CONTAINER_MAX_ENTRIES];	//The entries
+
+	CONTAINER_ERROR error;							//The error in the last operation
+}CONTAINER;
+
+/********************************************
+Function: directorySize(uint32_t)
+
+Purpose: Counts the size of the directory of a container.
+
+Inputs: The amount of entries.
+
+Returns: The size of the directory in bytes.
+
+Modifies: Nothing.
+
+Error checking: None.
+
+Sample call: uint32_t size = directorySize(toUInt(start));
+********************************************/
+uint32_t directorySize(uint32_t);
+
+/********************************************
+Function: packContainer(CONTAINER*, uint8_t**, uint32_t*)
+
+Purpose: Builds a container from the given entries. The
+	 container can then be embedded with the embedPayload()-
+	 function using the PAYLOAD_FLAG_CONTAINER flag.
+
+Inputs: The directory with the names, the lenghts, the codecs
+	and the parities of the entries filled, an array holding
+	the contents of each entry and a pointer where the lenght
+	of the container is stored.
+
+Returns: A pointer to the container or NULL on failure.
+
+Modifies: Fills the rest of the directory values. Reserves
+	  memory for the returned container, you must free
+	  this memory later by yourself.
+
+Error checking: Reports an error if:
+		there are too many entries,
+		a name is empty, too long or used twice,
+		a codec or a parity is not valid,
+		the memory allocation failed.
+
+Sample call: CONTAINER dir = {0};
+	     strcpy(dir.entries[0].name, "manifest");
+	     dir.entries[0].length = len;
+	     dir.count = 1;
+	     uint8_t* packed = packContainer(&dir, contents, &packedLenght);
+********************************************/
+uint8_t* packContainer(CONTAINER*, uint8_t**, uint32_t*);
+
+/********************************************
+Function: readDirectory(uint8_t*, uint32_t, CONTAINER*)
+
+Purpose: Reads the directory from the beginning of a
+	 container.
+
+Inputs: The first bytes of the container, the amount of bytes
+	given and the struct where the directory should be stored.
+	The bytes given must cover directorySize() bytes, but
+	the entries themselves are not needed.
+
+Returns: 1 on success 0 otherwise.
+	 If 0 was returned the error variable of the given
+	 struct tells the reason.
+
+Modifies: Overwrites the given struct.
+
+Error checking: Checks the checksum of the directory and that
+		the entries do not overlap or exceed the lenght
+		of the container.
+
+Sample call: if(readDirectory(bytes, size, &dir))
+		...
+********************************************/
+int readDirectory(uint8_t*, uint32_t, CONTAINER*);
+
+/********************************************
+Function: findEntry(CONTAINER*, char*)
+
+Purpose: Finds the entry with the given name.
+
+Inputs: The directory and the name.
+
+Returns: A pointer to the entry or NULL if there is no
+	 such entry.
+
+Modifies: Nothing.
+
+Error checking: None.
+
+Sample call: CONTAINER_ENTRY* entry = findEntry(&dir, "manifest");
+********************************************/
+CONTAINER_ENTRY* findEntry(CONTAINER*, char*);
+
+/********************************************
+Function: unpackEntry(uint8_t*, CONTAINER_ENTRY*, CONTAINER*)
+
+Purpose: Decodes the stored bytes of an entry.
+
+Inputs: The stored bytes of the entry (storedLength bytes from
+	directorySize() + offset on), the entry and the directory
+	the entry belongs to.
+
+Returns: A pointer to the contents of the entry or NULL on
+	 failure. For convenience the contents are followed by
+	 an extra null-character not counted in the lenght.
+
+Modifies: Reserves memory for the returned contents, you must
+	  free this memory later by yourself. Stores the amount
+	  of corrected bytes to the entry.
+
+Error checking: Reports an error to the directory if:
+		the entry has too many errors to be corrected,
+		the entry does not match its checksum,
+		the memory allocation failed.
+
+Sample call: uint8_t* contents = unpackEntry(stored, entry, &dir);
+********************************************/
+uint8_t* unpackEntry(uint8_t*, CONTAINER_ENTRY*, CONTAINER*);
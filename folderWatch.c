@@ -0,0 +1,308 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "folderWatch.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+//The longest key of a handled file: the size, the modification time and the name.
+#define KEY_LENGTH (WATCH_NAME_LENGTH + 48)
+
+//The monotonic time in seconds.
+static double now(){
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/*
+ * The handled files are kept in a hash set with open addressing.
+ * A file is identified by its name, size and modification time, so
+ * a file replaced with a new one is handled again.
+ */
+static size_t hashKey(const char* key){
+	size_t hash = 2166136261u;
+
+	for(; *key; key++)
+		hash = (hash ^ (unsigned char) *key) * 16777619u;
+	return hash;
+}
+
+//Returns the slot of the key, or the empty slot where it belongs.
+static size_t findSlot(char** slots, size_t count, const char* key){
+	size_t i = hashKey(key) & (count - 1);
+
+	while(slots[i] != NULL && strcmp(slots[i], key) != 0)
+		i = (i + 1) & (count - 1);
+	return i;
+}
+
+static int isHandled(FOLDER_WATCH* watch, const char* key){
+	return watch->handledSlots > 0 &&
+		watch->handled[findSlot(watch->handled, watch->handledSlots, key)] != NULL;
+}
+
+//Adds the key to the set. Returns 0 if there was not enough memory.
+static int addHandled(FOLDER_WATCH* watch, const char* key){
+	//The set is kept atmost half full.
+	if(2 * (watch->handledCount + 1) > watch->handledSlots){
+		size_t slots = watch->handledSlots ? 2 * watch->handledSlots : 1024;
+		char** grown = calloc(slots, sizeof(char*));
+		if(grown == NULL)
+			return 0;
+
+		for(size_t i = 0; i < watch->handledSlots; i++)
+			if(watch->handled[i] != NULL)
+				grown[findSlot(grown, slots, watch->handled[i])] = watch->handled[i];
+
+		free(watch->handled);
+		watch->handled = grown;
+		watch->handledSlots = slots;
+	}
+
+	size_t slot = findSlot(watch->handled, watch->handledSlots, key);
+	if(watch->handled[slot] != NULL)
+		return 1;
+
+	char* copy = malloc(strlen(key) + 1);
+	if(copy == NULL)
+		return 0;
+
+	strcpy(copy, key);
+	watch->handled[slot] = copy;
+	watch->handledCount++;
+	return 1;
+}
+
+static void makeKey(char* key, WATCH_ENTRY* entry){
+	snprintf(key, KEY_LENGTH, "%llu %lld %s", (unsigned long long) entry->size,
+		(long long) entry->modified, entry->name);
+}
+
+static int isBitmapName(const char* name){
+	size_t length = strlen(name);
+
+	return name[0] != '.' && length > 4 && length < WATCH_NAME_LENGTH
+		&& strcasecmp(&name[length - 4], ".bmp") == 0 && strchr(name, '\n') == NULL;
+}
+
+FOLDER_WATCH* openWatch(char* directory, char* stateFile){
+	FOLDER_WATCH* watch = calloc(1, sizeof(FOLDER_WATCH));
+	char line[KEY_LENGTH + 2];
+
+	if(watch == NULL)
+		return NULL;
+
+	pthread_mutex_init(&watch->lock, NULL);
+	watch->notify = -1;
+	snprintf(watch->directory, WATCH_PATH_LENGTH, "%s", directory);
+
+#ifdef __linux__
+	watch->notify = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+	if(watch->notify < 0 || inotify_add_watch(watch->notify, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0){
+		watch->error = WATCH_DIRECTORY_ERROR;
+		return watch;
+	}
+#else
+	watch->error = WATCH_NOT_SUPPORTED;
+	return watch;
+#endif
+
+	//The files handled before are read from the state file.
+	FILE* previous = fopen(stateFile, "r");
+	if(previous != NULL){
+		while(fgets(line, sizeof(line), previous) != NULL){
+			line[strcspn(line, "\n")] = '\0';
+			if(line[0] != '\0' && !addHandled(watch, line)){
+				fclose(previous);
+				watch->error = WATCH_MEMORY_ERROR;
+				return watch;
+			}
+		}
+		fclose(previous);
+	}
+
+	if((watch->state = fopen(stateFile, "a")) == NULL){
+		watch->error = WATCH_STATE_ERROR;
+		return watch;
+	}
+
+	watch->error = WATCH_OK;
+	return watch;
+}
+
+//Reports the file if it is a bitmap that has not been handled.
+static void report(FOLDER_WATCH* watch, const char* name, double landed,
+	void (*ready)(void*, WATCH_ENTRY*), void* context){
+
+	char key[KEY_LENGTH];
+	struct stat info;
+
+	if(!isBitmapName(name))
+		return;
+
+	WATCH_ENTRY* entry = malloc(sizeof(WATCH_ENTRY));
+	if(entry == NULL)
+		return;
+
+	int length = snprintf(entry->path, WATCH_PATH_LENGTH, "%s/%s", watch->directory, name);
+	if(length >= WATCH_PATH_LENGTH || stat(entry->path, &info) != 0 || !S_ISREG(info.st_mode)){
+		free(entry);
+		return;
+	}
+	entry->name = &entry->path[length - strlen(name)];
+	entry->size = info.st_size;
+	entry->modified = (int64_t) info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+	entry->landed = landed;
+
+	//The file is added to the set when it is reported, so it is not
+	//reported again while it is being handled. The state file is only
+	//written once the file has been handled.
+	makeKey(key, entry);
+	if(isHandled(watch, key) || !addHandled(watch, key)){
+		free(entry);
+		return;
+	}
+	ready(context, entry);
+}
+
+//Adds the file to the pending files or restarts its wait.
+static int addPending(FOLDER_WATCH* watch, const char* name){
+	if(strlen(name) >= WATCH_NAME_LENGTH)
+		return 1;
+
+	for(size_t i = 0; i < watch->pendingCount; i++)
+		if(strcmp(watch->pending[i].name, name) == 0){
+			watch->pending[i].landed = now();
+			return 1;
+		}
+
+	if(watch->pendingCount == watch->pendingSlots){
+		size_t slots = watch->pendingSlots ? 2 * watch->pendingSlots : 64;
+		WATCH_PENDING* grown = realloc(watch->pending, slots * sizeof(WATCH_PENDING));
+		if(grown == NULL)
+			return 0;
+
+		watch->pending = grown;
+		watch->pendingSlots = slots;
+	}
+
+	strcpy(watch->pending[watch->pendingCount].name, name);
+	watch->pending[watch->pendingCount++].landed = now();
+	return 1;
+}
+
+int runWatch(FOLDER_WATCH* watch, void (*ready)(void*, WATCH_ENTRY*), void* context, volatile sig_atomic_t* stop){
+#ifdef __linux__
+	//Events are read to a buffer aligned for the event structs.
+	union{
+		struct inotify_event event;
+		char bytes[64 * (sizeof(struct inotify_event) + WATCH_NAME_LENGTH)];
+	}buffer;
+
+	//The files added while the watch was not running.
+	DIR* directory = opendir(watch->directory);
+	if(directory != NULL){
+		struct dirent* file;
+		double start = now();
+
+		while(!*stop && (file = readdir(directory)) != NULL)
+			report(watch, file->d_name, start, ready, context);
+		closedir(directory);
+	}
+
+	while(!*stop){
+		//Waits until the next pending file is due, or atmost a second
+		//so that the stop flag is checked.
+		int timeout = 1000;
+		double current = now();
+
+		for(size_t i = 0; i < watch->pendingCount; i++){
+			double wait = (watch->pending[i].landed + WATCH_DEBOUNCE - current) * 1000;
+			if(wait < timeout)
+				timeout = wait > 0 ? (int) wait + 1 : 0;
+		}
+
+		struct pollfd events = {watch->notify, POLLIN, 0};
+		int result = poll(&events, 1, timeout);
+		if(result < 0 && errno != EINTR)
+			return 0;
+
+		if(result > 0){
+			ssize_t length;
+
+			while((length = read(watch->notify, buffer.bytes, sizeof(buffer.bytes))) > 0){
+				for(char* p = buffer.bytes; p < buffer.bytes + length;){
+					struct inotify_event* event = (struct inotify_event*) p;
+
+					if(event->len > 0 && isBitmapName(event->name) && !addPending(watch, event->name))
+						return 0;
+					p += sizeof(struct inotify_event) + event->len;
+				}
+			}
+			if(length < 0 && errno != EAGAIN && errno != EINTR)
+				return 0;
+		}
+
+		//The files left alone long enough are reported.
+		current = now();
+		for(size_t i = 0; i < watch->pendingCount;){
+			if(current - watch->pending[i].landed < WATCH_DEBOUNCE){
+				i++;
+				continue;
+			}
+			WATCH_PENDING due = watch->pending[i];
+			watch->pending[i] = watch->pending[--watch->pendingCount];
+			report(watch, due.name, due.landed, ready, context);
+		}
+	}
+	return 1;
+#else
+	(void) ready;
+	(void) context;
+	(void) stop;
+	watch->error = WATCH_NOT_SUPPORTED;
+	return 0;
+#endif
+}
+
+int markProcessed(FOLDER_WATCH* watch, WATCH_ENTRY* entry){
+	char key[KEY_LENGTH];
+	int success;
+
+	makeKey(key, entry);
+
+	pthread_mutex_lock(&watch->lock);
+	success = fprintf(watch->state, "%s\n", key) > 0 && fflush(watch->state) == 0;
+	pthread_mutex_unlock(&watch->lock);
+
+	return success;
+}
+
+void closeWatch(FOLDER_WATCH* watch){
+	if(watch == NULL)
+		return;
+
+	if(watch->notify >= 0)
+		close(watch->notify);
+	if(watch->state != NULL)
+		fclose(watch->state);
+
+	for(size_t i = 0; i < watch->handledSlots; i++)
+		free(watch->handled[i]);
+	free(watch->handled);
+	free(watch->pending);
+
+	pthread_mutex_destroy(&watch->lock);
+	free(watch);
+}
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <signal.h>
+#include <pthread.h>
+/*
+Purpose:
+	This modul watches a directory for new bitmap files.
+	The directory is not scanned again and again, instead
+	the kernel reports each file written to the directory
+	or moved there (with inotify, so this modul works
+	only on Linux).
+	A file may be written in several parts, so a file is
+	reported only after no events have been received for
+	it in WATCH_DEBOUNCE seconds.
+	The files handled are recorded to a state file, so
+	that after a restart only the new or changed files are
+	reported. When the watch starts, the files added while
+	it was not running are reported.
+
+Functions:
+	FOLDER_WATCH* openWatch(char*, char*)
+	int runWatch(FOLDER_WATCH*, void (*)(void*, WATCH_ENTRY*), void*, volatile sig_atomic_t*)
+	int markProcessed(FOLDER_WATCH*, WATCH_ENTRY*)
+	void closeWatch(FOLDER_WATCH*)
+
+Dependancies: None.
+*/
+
+//The time in seconds a file must be left alone before it is reported.
+#define WATCH_DEBOUNCE 0.02
+
+//The longest path handled by this modul.
+#define WATCH_PATH_LENGTH 4096
+
+//The longest file name handled by this modul.
+#define WATCH_NAME_LENGTH 256
+
+/********************************************
+Enum: WATCH_ERROR
+
+Purpose: The different error conditions the functions
+	 of this modul can run into.
+********************************************/
+typedef enum{
+	WATCH_OK,					//No error
+	WATCH_NOT_SUPPORTED,		//The system does not support watching directories
+	WATCH_DIRECTORY_ERROR,		//The directory could not be watched
+	WATCH_STATE_ERROR,			//The state file could not be opened
+	WATCH_MEMORY_ERROR			//A malloc operation returned NULL
+}WATCH_ERROR;
+
+/********************************************
+Struct: WATCH_ENTRY
+
+Purpose: Describes a file ready to be handled.
+********************************************/
+typedef struct{
+	char path[WATCH_PATH_LENGTH];	//The path of the file
+	char* name;						//The name of the file, points to the path
+	uint64_t size;					//The size of the file when it was reported
+	int64_t modified;				//The modification time in nanoseconds
+	double landed;					//The monotonic time of the last event for the file
+}WATCH_ENTRY;
+
+/********************************************
+Struct: WATCH_PENDING
+
+Purpose: A file waiting for its writes to end.
+********************************************/
+typedef struct{
+	char name[WATCH_NAME_LENGTH];	//The name of the file
+	double landed;					//The monotonic time of the last event for the file
+}WATCH_PENDING;
+
+/********************************************
+Struct: FOLDER_WATCH
+
+Purpose: Holds the state of a watch.
+
+Usage: You should not change these values manually, use
+       the functions of this modul instead.
+********************************************/
+typedef struct{
+	char directory[WATCH_PATH_LENGTH];	//The watched directory
+	int notify;							//The inotify descriptor
+
+	pthread_mutex_t lock;				//Protects the state
+	FILE* state;						//The state file, opened for appending
+	char** handled;						//A hash set of the handled files
+	size_t handledCount;				//The amount of handled files
+	size_t handledSlots;				//The size of the hash set
+
+	WATCH_PENDING* pending;				//The files waiting for their writes to end
+	size_t pendingCount;				//The amount of pending files
+	size_t pendingSlots;				//The size of the pending array
+
+	WATCH_ERROR error;					//The error in the last operation
+}FOLDER_WATCH;
+
+/********************************************
+Function: openWatch(char*, char*)
+
+Purpose: Starts watching the given directory.
+
+Inputs: The directory and the path of the state file.
+	The state file is created if it does not exist.
+
+Returns: A pointer to the watch, or NULL if there was not
+	 enough memory. If the error variable of the watch is
+	 not WATCH_OK the watch could not be started and should
+	 be closed.
+
+Modifies: Reserves memory for the watch, it is freed by the
+	  closeWatch()-function.
+
+Error checking: Reports an error if:
+		the system does not support watching directories,
+		the directory could not be watched,
+		the state file could not be opened or read.
+
+Sample call: FOLDER_WATCH* watch = openWatch("incoming", "incoming/.state");
+	     if(watch == NULL || watch->error != WATCH_OK)
+		...failure...
+********************************************/
+FOLDER_WATCH* openWatch(char*, char*);
+
+/********************************************
+Function: runWatch(FOLDER_WATCH*, void (*)(void*, WATCH_ENTRY*), void*, volatile sig_atomic_t*)
+
+Purpose: Reports the files of the directory that have not been
+	 handled, and then each new or changed file as soon as
+	 it has been written. Files starting with a dot and files
+	 not ending with .bmp are ignored.
+
+Inputs: The watch, the function the files are reported to, the
+	context given to the function and a flag wich stops the
+	watch when set to non-zero, e.g. from a signal handler.
+	The function owns the entry it is given, and it should
+	call the markProcessed()-function once the file has been
+	handled successfully.
+
+Returns: 1 when stopped by the flag, 0 on failure.
+
+Modifies: The state of the watch.
+
+Error checking: Returns 0 if reading the events fails.
+
+Sample call: runWatch(watch, handleFile, &settings, &stop);
+********************************************/
+int runWatch(FOLDER_WATCH*, void (*)(void*, WATCH_ENTRY*), void*, volatile sig_atomic_t*);
+
+/********************************************
+Function: markProcessed(FOLDER_WATCH*, WATCH_ENTRY*)
+
+Purpose: Records the given file as handled to the state file.
+	 This function is thread safe.
+
+Inputs: The watch and the entry reported for the file.
+
+Returns: 1 on success 0 if writing the state file failed.
+
+Modifies: The state file.
+
+Error checking: None.
+
+Sample call: markProcessed(watch, entry);
+********************************************/
+int markProcessed(FOLDER_WATCH*, WATCH_ENTRY*);
+
+/********************************************
+Function: closeWatch(FOLDER_WATCH*)
+
+Purpose: Stops the watch and frees its memory.
+
+Inputs: The watch.
+
+Returns: Nothing.
+
+Modifies: Frees the watch.
+
+Error checking: Does nothing if the watch is NULL.
+
+Sample call: closeWatch(watch);
+********************************************/
+void closeWatch(FOLDER_WATCH*);
@@ -0,0 +1,57 @@
+#define _POSIX_C_SOURCE 200809L
+#include <string.h>
+#include <time.h>
+#include "jobControl.h"
+
+//The current time of the monotonic clock in seconds.
+static double now(){
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+void jobInit(JOB_CONTROL* job){
+	memset(job, 0, sizeof(JOB_CONTROL));
+	job->status = JOB_RUNNING;
+}
+
+void jobSetTimeout(JOB_CONTROL* job, double seconds){
+	job->deadline = seconds > 0 ? now() + seconds : 0;
+}
+
+void jobCancel(JOB_CONTROL* job){
+	job->cancelled = 1;
+}
+
+void jobStart(JOB_CONTROL* job, uint64_t total){
+	if(job == NULL)
+		return;
+
+	job->done = 0;
+	job->total = total;
+	job->checked = 0;
+}
+
+int jobCheck(JOB_CONTROL* job, uint64_t done){
+	if(job == NULL)
+		return 1;
+
+	job->done = done;
+	if(job->cancelled){
+		job->status = JOB_CANCELLED;
+		return 0;
+	}
+	if(done - job->checked < JOB_CHECK_INTERVAL && done < job->total)
+		return 1;
+
+	job->checked = done;
+	if(job->progress != NULL)
+		job->progress(job->context, done, job->total);
+
+	if(job->deadline > 0 && now() >= job->deadline){
+		job->status = JOB_DEADLINE_PASSED;
+		return 0;
+	}
+	return 1;
+}
@@ -0,0 +1,163 @@
+#include <stdint.h>
+#include <signal.h>
+/*
+Purpose:
+	This modul lets long running operations, like parsing
+	or writing a large bitmap, be interrupted and followed.
+	A JOB_CONTROL struct is given to the operation, wich
+	checks it regularly while processing. The job can be
+	cancelled at any time, also from a signal handler or an
+	other thread, and it can be given a deadline. A callback
+	can be set for following the progress.
+
+	The checks are made atmost once for each JOB_CHECK_INTERVAL
+	bytes processed, so the overhead does not depend on the
+	amount of rows or runs processed.
+
+Functions:
+	void jobInit(JOB_CONTROL*)
+	void jobSetTimeout(JOB_CONTROL*, double)
+	void jobCancel(JOB_CONTROL*)
+	void jobStart(JOB_CONTROL*, uint64_t)
+	int jobCheck(JOB_CONTROL*, uint64_t)
+
+Dependancies: None.
+*/
+
+//The amount of bytes processed between the checks of the clock.
+#define JOB_CHECK_INTERVAL (1 << 18)
+
+/********************************************
+Enum: JOB_STATUS
+
+Purpose: Tells whether a job may continue.
+********************************************/
+typedef enum{
+	JOB_RUNNING,			//The job may continue
+	JOB_CANCELLED,			//The job has been cancelled
+	JOB_DEADLINE_PASSED		//The deadline of the job has passed
+}JOB_STATUS;
+
+/********************************************
+Struct: JOB_CONTROL
+
+Purpose: Holds the deadline, the cancellation flag and
+	 the progress of a job.
+
+Usage: Initialize the struct with the jobInit()-function
+       and set the progress and the context variables if
+       the progress should be followed. The done and the
+       total variables tell the progress of the current step
+       of the job, also after the job has been stopped.
+********************************************/
+typedef struct JOB_CONTROL{
+	volatile sig_atomic_t cancelled;	//Is 1 if the job has been cancelled
+	double deadline;					//The deadline in seconds of the monotonic clock, 0 for none
+
+	void (*progress)(void* context, uint64_t done, uint64_t total);	//Called at every check, or NULL
+	void* context;						//Given to the progress callback
+
+	uint64_t done;						//The amount of bytes processed in the current step
+	uint64_t total;						//The amount of bytes in the current step
+	uint64_t checked;					//The value of done at the last check
+
+	JOB_STATUS status;					//The status of the job
+}JOB_CONTROL;
+
+/********************************************
+Function: jobInit(JOB_CONTROL*)
+
+Purpose: Initializes a job without a deadline or a progress
+	 callback.
+
+Inputs: The struct to be initialized.
+
+Returns: Nothing.
+
+Modifies: Overwrites the given struct.
+
+Error checking: None.
+
+Sample call: JOB_CONTROL job;
+	     jobInit(&job);
+	     file->control = &job;
+********************************************/
+void jobInit(JOB_CONTROL*);
+
+/********************************************
+Function: jobSetTimeout(JOB_CONTROL*, double)
+
+Purpose: Sets the deadline of the job to the given amount
+	 of seconds from now.
+
+Inputs: The job and the amount of seconds. 0 or less removes
+	the deadline.
+
+Returns: Nothing.
+
+Modifies: The deadline of the job.
+
+Error checking: None.
+
+Sample call: jobSetTimeout(&job, 2.5);
+********************************************/
+void jobSetTimeout(JOB_CONTROL*, double);
+
+/********************************************
+Function: jobCancel(JOB_CONTROL*)
+
+Purpose: Cancels the job. The job stops at its next check.
+
+Inputs: The job.
+
+Returns: Nothing.
+
+Modifies: The cancelled variable of the job. This function
+	  only sets a flag, so it is safe to call from a signal
+	  handler or an other thread.
+
+Error checking: None.
+
+Sample call: jobCancel(&job);
+********************************************/
+void jobCancel(JOB_CONTROL*);
+
+/********************************************
+Function: jobStart(JOB_CONTROL*, uint64_t)
+
+Purpose: Starts a new step of the job, e.g. parsing or writing
+	 the data of a bitmap.
+
+Inputs: The job and the amount of bytes the step processes.
+
+Returns: Nothing.
+
+Modifies: Resets the progress of the job.
+
+Error checking: Does nothing if the job is NULL.
+
+Sample call: jobStart(file->control, dataSize(file));
+********************************************/
+void jobStart(JOB_CONTROL*, uint64_t);
+
+/********************************************
+Function: jobCheck(JOB_CONTROL*, uint64_t)
+
+Purpose: Updates the progress of the job and tells whether
+	 the job may continue. The clock is read and the progress
+	 callback called only when JOB_CHECK_INTERVAL bytes have
+	 been processed since the last check, or the step is done.
+
+Inputs: The job and the amount of bytes processed in the
+	current step.
+
+Returns: 1 if the job may continue, 0 if it should stop.
+
+Modifies: The progress and the status of the job.
+
+Error checking: A NULL job may always continue.
+
+Sample call: if(!jobCheck(file->control, done))
+		...stop...
+********************************************/
+int jobCheck(JOB_CONTROL*, uint64_t);
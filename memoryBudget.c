@@ -0,0 +1,44 @@
+#include "memoryBudget.h"
+
+void budgetInit(MEMORY_BUDGET* budget, uint64_t limit){
+	pthread_mutex_init(&budget->lock, NULL);
+	pthread_cond_init(&budget->released, NULL);
+	budget->limit = limit;
+	budget->reserved = 0;
+	budget->peak = 0;
+}
+
+int budgetReserve(MEMORY_BUDGET* budget, uint64_t bytes){
+	if(budget->limit > 0 && bytes > budget->limit)
+		return 0;
+
+	pthread_mutex_lock(&budget->lock);
+	while(budget->limit > 0 && budget->reserved + bytes > budget->limit)
+		pthread_cond_wait(&budget->released, &budget->lock);
+
+	budget->reserved += bytes;
+	if(budget->reserved > budget->peak)
+		budget->peak = budget->reserved;
+	pthread_mutex_unlock(&budget->lock);
+
+	return 1;
+}
+
+void budgetRelease(MEMORY_BUDGET* budget, uint64_t bytes){
+	pthread_mutex_lock(&budget->lock);
+	budget->reserved -= bytes;
+	pthread_cond_broadcast(&budget->released);
+	pthread_mutex_unlock(&budget->lock);
+}
+
+void budgetStats(MEMORY_BUDGET* budget, uint64_t* reserved, uint64_t* peak){
+	pthread_mutex_lock(&budget->lock);
+	*reserved = budget->reserved;
+	*peak = budget->peak;
+	pthread_mutex_unlock(&budget->lock);
+}
+
+void budgetDestroy(MEMORY_BUDGET* budget){
+	pthread_mutex_destroy(&budget->lock);
+	pthread_cond_destroy(&budget->released);
+}
@@ -0,0 +1,136 @@
+#include <stdint.h>
+#include <pthread.h>
+/*
+Purpose:
+	This modul keeps the memory used by concurrent jobs
+	under a common limit. Before a job reserves its
+	buffers it asks the budget for the amount of memory it
+	will need, and waits until the jobs allready running
+	have released enough of the budget. The amount of
+	memory reserved at the moment and the largest amount
+	reserved at once are kept for statistics.
+
+Functions:
+	void budgetInit(MEMORY_BUDGET*, uint64_t)
+	int budgetReserve(MEMORY_BUDGET*, uint64_t)
+	void budgetRelease(MEMORY_BUDGET*, uint64_t)
+	void budgetStats(MEMORY_BUDGET*, uint64_t*, uint64_t*)
+	void budgetDestroy(MEMORY_BUDGET*)
+
+Dependancies: None.
+*/
+
+/********************************************
+Struct: MEMORY_BUDGET
+
+Purpose: Holds the limit and the amount of memory reserved
+	 by the jobs.
+
+Usage: You should not change these values manually, use
+       the functions of this modul instead.
+********************************************/
+typedef struct{
+	pthread_mutex_t lock;		//Protects the rest of the values
+	pthread_cond_t released;	//Signalled when memory is released
+	uint64_t limit;				//The amount of memory available, 0 for no limit
+	uint64_t reserved;			//The amount of memory reserved at the moment
+	uint64_t peak;				//The largest amount of memory reserved at once
+}MEMORY_BUDGET;
+
+/********************************************
+Function: budgetInit(MEMORY_BUDGET*, uint64_t)
+
+Purpose: Initializes a budget with nothing reserved.
+
+Inputs: The budget and the amount of memory available in
+	bytes, 0 for no limit.
+
+Returns: Nothing.
+
+Modifies: Overwrites the given struct.
+
+Error checking: None.
+
+Sample call: budgetInit(&budget, 512 << 20);
+********************************************/
+void budgetInit(MEMORY_BUDGET*, uint64_t);
+
+/********************************************
+Function: budgetReserve(MEMORY_BUDGET*, uint64_t)
+
+Purpose: Reserves the given amount of memory from the
+	 budget. If the memory is not available, waits until
+	 the other jobs have released enough of it.
+	 This function is thread safe.
+
+Inputs: The budget and the amount of memory in bytes.
+
+Returns: 1 when the memory has been reserved, 0 if the amount
+	 is larger than the whole budget and could never be
+	 reserved.
+
+Modifies: The reserved amount of the budget.
+
+Error checking: None.
+
+Sample call: if(!budgetReserve(&budget, dataSize(file)))
+		...the job does not fit...
+********************************************/
+int budgetReserve(MEMORY_BUDGET*, uint64_t);
+
+/********************************************
+Function: budgetRelease(MEMORY_BUDGET*, uint64_t)
+
+Purpose: Returns memory reserved with the budgetReserve()-
+	 function to the budget, and wakes up the jobs waiting
+	 for it. This function is thread safe.
+
+Inputs: The budget and the amount of memory in bytes.
+
+Returns: Nothing.
+
+Modifies: The reserved amount of the budget.
+
+Error checking: None.
+
+Sample call: budgetRelease(&budget, dataSize(file));
+********************************************/
+void budgetRelease(MEMORY_BUDGET*, uint64_t);
+
+/********************************************
+Function: budgetStats(MEMORY_BUDGET*, uint64_t*, uint64_t*)
+
+Purpose: Tells how much memory is reserved at the moment,
+	 and the largest amount reserved at once.
+	 This function is thread safe.
+
+Inputs: The budget and pointers where the amounts are stored.
+
+Returns: Nothing.
+
+Modifies: Overwrites the values pointed by the last two arguments.
+
+Error checking: None.
+
+Sample call: uint64_t reserved, peak;
+	     budgetStats(&budget, &reserved, &peak);
+********************************************/
+void budgetStats(MEMORY_BUDGET*, uint64_t*, uint64_t*);
+
+/********************************************
+Function: budgetDestroy(MEMORY_BUDGET*)
+
+Purpose: Frees the resources of the budget. No job may be
+	 waiting for the budget.
+
+Inputs: The budget.
+
+Returns: Nothing.
+
+Modifies: The given struct.
+
+Error checking: None.
+
+Sample call: budgetDestroy(&budget);
+********************************************/
+void budgetDestroy(MEMORY_BUDGET*);
@@ -0,0 +1,792 @@
+#include <stdlib.h>
+#include <string.h>
+#include "bitModul.h"
+#include "reedSolomon.h"
+#include "checksum.h"
+#include "payloadFormat.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const uint8_t magic[4] = {'B', 'M', 'P', 'C'};
+
+//The amount of stored bytes extracted before updating the checksum,
+//small enough for the extracted bytes to still be in the cache.
+#define CHECKSUM_CHUNK 256
+
+//The amount of stored bytes extracted at a time by extractRange()
+//when the data is read from a source.
+#define RANGE_CHUNK 65536
+
+//Tells how the payload is split to codewords when FEC is used.
+static void codewordLayout(uint32_t length, int parity, uint32_t* blocks, uint32_t* blockData){
+	uint32_t maxData = RS_MAX_CODEWORD - parity;
+
+	*blocks = (length + maxData - 1) / maxData;
+	if(*blocks == 0)
+		*blocks = 1;
+	*blockData = (length + *blocks - 1) / *blocks;
+}
+
+uint32_t fecSize(uint32_t length, int parity){
+	uint32_t blocks, blockData;
+
+	codewordLayout(length, parity, &blocks, &blockData);
+	return blocks * (blockData + parity);
+}
+
+//Counts the lenght of the payload after FEC encoding.
+static uint32_t storedSize(uint32_t length, PAYLOAD_INFO* info){
+	if(!(info->flags & PAYLOAD_FLAG_FEC))
+		return length;
+
+	return fecSize(length, info->fecParity);
+}
+
+void fecEncode(uint8_t* data, uint32_t length, int parity, uint8_t* stored){
+	uint32_t blocks, blockData;
+	uint8_t codeword[RS_MAX_CODEWORD],
+		gen[RS_MAX_PARITY + 1];
+
+	rsInit();
+	codewordLayout(length, parity, &blocks, &blockData);
+	rsGenerator(parity, gen);
+
+	//Byte j of codeword b is stored at position j * blocks + b
+	//so the codewords are interleaved over the whole body.
+	for(uint32_t b = 0; b < blocks; b++){
+		memset(codeword, 0, blockData);
+		uint32_t start = b * blockData;
+		if(start < length)
+			memcpy(codeword, &data[start], start + blockData <= length ? blockData : length - start);
+
+		rsEncode(codeword, blockData, gen, parity, &codeword[blockData]);
+
+		for(uint32_t j = 0; j < blockData + parity; j++)
+			stored[j * blocks + b] = codeword[j];
+	}
+}
+
+int fecDecode(uint8_t* stored, uint32_t length, int parity, uint8_t* data, uint32_t* crc){
+	uint32_t blocks, blockData;
+	uint8_t codeword[RS_MAX_CODEWORD];
+	int corrected = 0;
+
+	rsInit();
+	codewordLayout(length, parity, &blocks, &blockData);
+	*crc = 0;
+
+	for(uint32_t b = 0; b < blocks; b++){
+		for(uint32_t j = 0; j < blockData + parity; j++)
+			codeword[j] = stored[j * blocks + b];
+
+		int fixed = rsDecode(codeword, blockData + parity, parity);
+		if(fixed < 0)
+			return -1;
+		corrected += fixed;
+
+		//The checksum is computed from the corrected codewords.
+		uint32_t start = b * blockData;
+		if(start < length){
+			uint32_t count = start + blockData <= length ? blockData : length - start;
+			memcpy(&data[start], codeword, count);
+			*crc = crc32c(*crc, codeword, count);
+		}
+	}
+	return corrected;
+}
+
+static int validOptions(PAYLOAD_INFO* info){
+	if(info->flags & ~(PAYLOAD_FLAG_FEC | PAYLOAD_FLAG_MATRIX | PAYLOAD_FLAG_CONTAINER | PAYLOAD_FLAG_ADAPTIVE))
+		return 0;
+
+	//The blocks used by adaptive embedding can only be found by
+	//going through the image, so they hold whole stored bytes.
+	if((info->flags & PAYLOAD_FLAG_ADAPTIVE) && (info->flags & (PAYLOAD_FLAG_MATRIX | PAYLOAD_FLAG_CONTAINER)))
+		return 0;
+
+	//The entries of a container carry their own FEC so that
+	//they can be extracted one at a time.
+	if((info->flags & PAYLOAD_FLAG_FEC) && (info->flags & PAYLOAD_FLAG_CONTAINER))
+		return 0;
+
+	if((info->flags & PAYLOAD_FLAG_FEC) &&
+		(info->fecParity < 2 || info->fecParity > MAX_FEC_PARITY || info->fecParity % 2 != 0))
+		return 0;
+
+	if((info->flags & PAYLOAD_FLAG_MATRIX) &&
+		(info->matrixK < MATRIX_MIN_K || info->matrixK > MATRIX_MAX_K))
+		return 0;
+
+	return 1;
+}
+
+/*
+ * Adaptive embedding uses only the blocks of ADAPTIVE_BLOCK x ADAPTIVE_BLOCK
+ * pixels with the most texture. The texture of a block is the sum of the
+ * differences between the neighbouring bytes of the same colour, counted
+ * without the last bits. Embedding never changes it, so the decoder finds
+ * the same blocks from the encoded image.
+ * The blocks are numbered row by row in the order of the data area. The
+ * texture is computed when a block is visited, only a histogram of the
+ * texture classes is kept while choosing the threshold.
+ */
+
+//The amount of data bytes in a row of a block.
+#define BLOCK_BYTES (ADAPTIVE_BLOCK * 3)
+
+//The amount of stored bytes carried by a block.
+#define BLOCK_STORED (ADAPTIVE_BLOCK * BLOCK_BYTES / 8)
+
+//The texture is divided by 2^COST_SHIFT to get its class.
+#define COST_SHIFT 7
+
+//Tells the range of blocks [*first, *end) that can be used. The
+//blocks overlapping the header are skipped, they are all on the
+//first row of blocks.
+static void blockRange(unsigned int areaSize, uint32_t rowBytes, uint32_t* first, uint32_t* end){
+	*first = *end = 0;
+	if(rowBytes < BLOCK_BYTES)
+		return;
+
+	uint32_t perRow = rowBytes / BLOCK_BYTES,
+			 skipped = (HEADER_AREA + BLOCK_BYTES - 1) / BLOCK_BYTES;
+
+	*end = perRow * (areaSize / rowBytes / ADAPTIVE_BLOCK);
+	*first = skipped < *end ? skipped : *end;
+}
+
+static uint8_t* blockAt(uint8_t* area, uint32_t rowBytes, uint32_t index){
+	uint32_t perRow = rowBytes / BLOCK_BYTES;
+
+	return &area[(uint64_t) (index / perRow) * ADAPTIVE_BLOCK * rowBytes + (index % perRow) * BLOCK_BYTES];
+}
+
+//Counts the texture class of the block. Each byte is compared to the
+//same colour of the next pixel and of the pixel on the next row.
+static uint32_t textureClass(uint8_t* block, uint32_t rowBytes){
+	uint32_t cost = 0;
+
+#ifdef __SSE2__
+	__m128i mask = _mm_set1_epi8((char) 0xFE),
+			sum = _mm_setzero_si128(),
+			above[3], x[3];
+
+	for(int r = 0; r < ADAPTIVE_BLOCK; r++){
+		uint8_t* row = &block[r * rowBytes];
+
+		for(int i = 0; i < 3; i++)
+			x[i] = _mm_and_si128(_mm_loadu_si128((__m128i*) &row[16 * i]), mask);
+
+		//The last comparison is shifted to stay inside the block, so
+		//the bytes 29 - 31 of a row are counted twice.
+		sum = _mm_add_epi64(sum, _mm_sad_epu8(x[0], _mm_and_si128(_mm_loadu_si128((__m128i*) &row[3]), mask)));
+		sum = _mm_add_epi64(sum, _mm_sad_epu8(x[1], _mm_and_si128(_mm_loadu_si128((__m128i*) &row[19]), mask)));
+		sum = _mm_add_epi64(sum, _mm_sad_epu8(x[2], _mm_and_si128(_mm_loadu_si128((__m128i*) &row[29]), mask)));
+
+		for(int i = 0; i < 3; i++){
+			if(r > 0)
+				sum = _mm_add_epi64(sum, _mm_sad_epu8(x[i], above[i]));
+			above[i] = x[i];
+		}
+	}
+	cost = (uint32_t) (_mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8)));
+#else
+	for(int r = 0; r < ADAPTIVE_BLOCK; r++){
+		uint8_t* row = &block[r * rowBytes];
+
+		for(int c = 0; c < 32; c++)
+			cost += abs((row[c] & 0xFE) - (row[c + 3] & 0xFE));
+		for(int c = 29; c < 45; c++)
+			cost += abs((row[c] & 0xFE) - (row[c + 3] & 0xFE));
+
+		if(r > 0){
+			uint8_t* above = row - rowBytes;
+			for(int c = 0; c < BLOCK_BYTES; c++)
+				cost += abs((row[c] & 0xFE) - (above[c] & 0xFE));
+		}
+	}
+#endif
+	cost >>= COST_SHIFT;
+	return cost < ADAPTIVE_CLASSES ? cost : ADAPTIVE_CLASSES - 1;
+}
+
+//Chooses the highest texture class for wich the blocks of that class
+//or above can hold the stored bytes.
+static uint32_t chooseThreshold(uint8_t* area, unsigned int areaSize, uint32_t rowBytes, uint32_t storedLength){
+	uint32_t counts[ADAPTIVE_CLASSES] = {0},
+			 first, end;
+
+	blockRange(areaSize, rowBytes, &first, &end);
+	for(uint32_t b = first; b < end; b++)
+		counts[textureClass(blockAt(area, rowBytes, b), rowBytes)]++;
+
+	uint32_t t = ADAPTIVE_CLASSES - 1;
+	uint64_t room = (uint64_t) counts[t] * BLOCK_STORED;
+	while(room < storedLength && t > 0)
+		room += (uint64_t) counts[--t] * BLOCK_STORED;
+
+	return t;
+}
+
+//Embeds or extracts the first count stored bytes to or from the
+//blocks at or above the threshold of the header.
+static void adaptiveStored(uint8_t* area, unsigned int areaSize, uint8_t* bytes,
+	uint32_t count, PAYLOAD_INFO* info, int embed){
+
+	uint32_t rowBytes = info->rowBytes,
+			 first, end, done = 0;
+
+	blockRange(areaSize, rowBytes, &first, &end);
+	for(uint32_t b = first; b < end && done < count; b++){
+		uint8_t* block = blockAt(area, rowBytes, b);
+		if(textureClass(block, rowBytes) < info->threshold)
+			continue;
+
+		//A row of a block holds BLOCK_BYTES / 8 stored bytes.
+		for(uint32_t j = 0; j < BLOCK_STORED && done < count; j++, done++){
+			uint8_t* bits = &block[(j / (BLOCK_BYTES / 8)) * rowBytes + (j % (BLOCK_BYTES / 8)) * 8];
+			if(embed)
+				encode(bits, bytes[done]);
+			else
+				bytes[done] = decode(bits);
+		}
+	}
+}
+
+//Counts how many stored bytes fit after the header.
+static uint32_t bodyCapacity(unsigned int areaSize, PAYLOAD_INFO* info){
+	if(areaSize < HEADER_AREA)
+		return 0;
+
+	if(info->flags & PAYLOAD_FLAG_ADAPTIVE){
+		uint32_t first, end;
+
+		blockRange(areaSize, info->rowBytes, &first, &end);
+		return (end - first) * BLOCK_STORED;
+	}
+
+	uint32_t bodyBytes = areaSize - HEADER_AREA;
+	if(!(info->flags & PAYLOAD_FLAG_MATRIX))
+		return bodyBytes / 8;
+
+	//Each block of 2^k - 1 bytes carries k bits.
+	uint32_t n = (1u << info->matrixK) - 1;
+	return (uint32_t) (((uint64_t) (bodyBytes / n) * info->matrixK) / 8);
+}
+
+unsigned int payloadCapacity(unsigned int areaSize, PAYLOAD_INFO* info){
+	uint32_t bodySize = bodyCapacity(areaSize, info);
+
+	//storedSize() grows with the lenght so the largest
+	//fitting lenght can be searched for.
+	uint32_t low = 0, high = bodySize;
+	while(low < high){
+		uint32_t mid = low + (high - low + 1) / 2;
+		if(storedSize(mid, info) <= bodySize)
+			low = mid;
+		else
+			high = mid - 1;
+	}
+	return low;
+}
+
+/*
+ * Matrix embedding uses the [2^k - 1, k] Hamming code. The k bits
+ * carried by a block are the syndrome of the last bits of the block,
+ * e.g. the xor of the (1-based) indices of the bytes wich last bit
+ * is set. Any syndrome can be reached by flipping atmost one bit.
+ *
+ * The last bits of a block are gathered to a single 64 bit word, so
+ * each syndrome bit is the parity of the word masked with the indices
+ * having that bit set.
+ */
+static uint64_t syndromeMasks[MATRIX_MAX_K];
+static int masksReady = 0;
+
+static void initSyndromeMasks(){
+	if(masksReady)
+		return;
+
+	for(int t = 0; t < MATRIX_MAX_K; t++){
+		syndromeMasks[t] = 0;
+		for(int i = 0; i < 63; i++)
+			if(((i + 1) >> t) & 1)
+				syndromeMasks[t] |= (uint64_t) 1 << i;
+	}
+	masksReady = 1;
+}
+
+void payloadInit(){
+	rsInit();
+	crcInit();
+	initSyndromeMasks();
+}
+
+static unsigned int syndrome(uint8_t* block, int n, int k){
+	uint64_t bits = 0;
+	int i = 0;
+
+#ifdef __SSE2__
+	//Moves the last bits of 16 bytes at a time to the sign bits.
+	for(; i + 16 <= n; i += 16){
+		__m128i x = _mm_loadu_si128((__m128i*) &block[i]);
+		bits |= (uint64_t) _mm_movemask_epi8(_mm_slli_epi16(x, 7)) << i;
+	}
+#endif
+	for(; i < n; i++)
+		bits |= (uint64_t) (block[i] & 1) << i;
+
+	unsigned int s = 0;
+	for(int t = 0; t < k; t++)
+		s |= (unsigned int) __builtin_parityll(bits & syndromeMasks[t]) << t;
+
+	return s;
+}
+
+//Decodes count bytes from the last bits of 8 * count data bytes, the
+//same way as the decode()-function decodes a single byte.
+static void decodeBytes(uint8_t* data, uint8_t* bytes, uint32_t count){
+	uint32_t i = 0;
+
+#ifdef __SSE2__
+	//The order of the bytes in each half is reversed so that the
+	//first data byte gives the most significant bit, and then the
+	//last bits are moved to the sign bits.
+	for(; i + 2 <= count; i += 2){
+		__m128i x = _mm_loadu_si128((__m128i*) &data[i * 8]);
+		x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0x1B), 0x1B);
+		x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+
+		int bits = _mm_movemask_epi8(_mm_slli_epi16(x, 7));
+		bytes[i] = (uint8_t) bits;
+		bytes[i + 1] = (uint8_t) (bits >> 8);
+	}
+#endif
+	for(; i < count; i++)
+		bytes[i] = decode(&data[i * 8]);
+}
+
+//The functions below address the body as if it started right after
+//the current header. A body starting elsewhere is handled by moving
+//the window by this amount.
+static uint32_t bodyShift(PAYLOAD_INFO* info){
+	//Data encoded with encodeData() starts from the beginning of
+	//the data area instead of after the header.
+	if(info->flags & PAYLOAD_FLAG_LEGACY)
+		return HEADER_AREA;
+
+	return 0;
+}
+
+/*
+ * The functions below work on a window of the data area. The window
+ * starts from the data byte windowStart and must cover all the data
+ * bytes used by the stored bytes handled, as told by payloadSpan().
+ * Byte q of the stored bytes is handled as bits 8q ... 8q + 7, the
+ * most significant bit first.
+ */
+
+//Embeds the stored bytes [first, first + count) to the window.
+static void embedStored(uint8_t* window, uint32_t windowStart, uint8_t* bytes,
+	uint32_t first, uint32_t count, PAYLOAD_INFO* info){
+
+	if(!(info->flags & PAYLOAD_FLAG_MATRIX)){
+		for(uint32_t i = 0; i < count; i++)
+			encode(&window[HEADER_AREA + (first + i) * 8 - windowStart], bytes[i]);
+		return;
+	}
+
+	int k = info->matrixK,
+		n = (1 << k) - 1;
+	uint64_t bitStart = (uint64_t) first * 8,
+			 bitEnd = bitStart + (uint64_t) count * 8;
+
+	for(uint64_t b = bitStart / k; b * k < bitEnd; b++){
+		uint8_t* block = &window[HEADER_AREA + b * n - windowStart];
+		unsigned int current = syndrome(block, n, k),
+					 wanted = 0;
+
+		//The bits of the block outside of the range keep their values.
+		for(int i = 0; i < k; i++){
+			uint64_t bit = b * k + i;
+			unsigned int v = (current >> (k - 1 - i)) & 1;
+			if(bit >= bitStart && bit < bitEnd)
+				v = (bytes[(bit - bitStart) / 8] >> (7 - (bit - bitStart) % 8)) & 1;
+			wanted = (wanted << 1) | v;
+		}
+		if(current != wanted)
+			block[(current ^ wanted) - 1] ^= 1;
+	}
+}
+
+//Extracts the stored bytes [first, first + count) from the window.
+static void extractStored(uint8_t* window, uint32_t windowStart, uint8_t* bytes,
+	uint32_t first, uint32_t count, PAYLOAD_INFO* info){
+
+	if(!(info->flags & PAYLOAD_FLAG_MATRIX)){
+		decodeBytes(&window[HEADER_AREA + first * 8 - windowStart], bytes, count);
+		return;
+	}
+
+	int k = info->matrixK,
+		n = (1 << k) - 1;
+	uint64_t bitStart = (uint64_t) first * 8,
+			 bitEnd = bitStart + (uint64_t) count * 8;
+
+	memset(bytes, 0, count);
+	for(uint64_t b = bitStart / k; b * k < bitEnd; b++){
+		unsigned int s = syndrome(&window[HEADER_AREA + b * n - windowStart], n, k);
+
+		for(int i = 0; i < k; i++){
+			uint64_t bit = b * k + i;
+			if(bit >= bitStart && bit < bitEnd && ((s >> (k - 1 - i)) & 1))
+				bytes[(bit - bitStart) / 8] |= 0x80 >> ((bit - bitStart) % 8);
+		}
+	}
+}
+
+void payloadSpan(PAYLOAD_INFO* info, uint32_t first, uint32_t count, uint32_t* start, uint32_t* end){
+	if(!(info->flags & PAYLOAD_FLAG_MATRIX)){
+		*start = HEADER_AREA + first * 8;
+		*end = HEADER_AREA + (first + count) * 8;
+		return;
+	}
+
+	uint64_t k = info->matrixK,
+			 n = (1 << k) - 1,
+			 bitStart = (uint64_t) first * 8,
+			 bitEnd = bitStart + (uint64_t) count * 8;
+
+	*start = HEADER_AREA + (bitStart / k) * n;
+	*end = HEADER_AREA + ((bitEnd + k - 1) / k) * n;
+}
+
+unsigned int payloadAreaSize(uint32_t length, PAYLOAD_INFO* info){
+	uint32_t start, end;
+
+	if(info->flags & PAYLOAD_FLAG_ADAPTIVE)
+		return UINT32_MAX;
+
+	payloadSpan(info, 0, storedSize(length, info), &start, &end);
+	return end;
+}
+
+void writePayloadHeader(uint8_t* area, PAYLOAD_INFO* info){
+	uint8_t header[HEADER_SIZE] = {0},
+		gen[HEADER_PARITY + 1];
+
+	rsInit();
+
+	memcpy(header, magic, 4);
+	header[4] = HEADER_VERSION;
+	header[5] = info->flags;
+	header[6] = info->fecParity;
+	header[7] = info->matrixK;
+	fromUInt(info->length, &header[8]);
+	//With adaptive embedding the stored lenght follows from the
+	//lenght, and the field holds the threshold instead.
+	fromUInt((info->flags & PAYLOAD_FLAG_ADAPTIVE) ? info->threshold : info->storedLength, &header[12]);
+	fromUInt(info->checksum, &header[16]);
+	fromUInt(crc32c(0, header, 20), &header[20]);
+
+	rsGenerator(HEADER_PARITY, gen);
+	rsEncode(header, HEADER_FIELDS, gen, HEADER_PARITY, &header[HEADER_FIELDS]);
+
+	for(int i = 0; i < HEADER_SIZE; i++)
+		encode(&area[i * 8], header[i]);
+}
+
+int readPayloadHeader(uint8_t* area, unsigned int areaSize, PAYLOAD_INFO* info){
+	uint8_t header[HEADER_SIZE];
+
+	rsInit();
+	initSyndromeMasks();
+	info->error = PAYLOAD_NO_HEADER;
+	if(area == NULL || areaSize < HEADER_AREA)
+		return 0;
+
+	decodeBytes(area, header, HEADER_SIZE);
+
+	if(rsDecode(header, HEADER_SIZE, HEADER_PARITY) < 0)
+		return 0;
+
+	if(memcmp(header, magic, 4) != 0 || header[4] != HEADER_VERSION
+		|| crc32c(0, header, 20) != toUInt(&header[20]))
+		return 0;
+
+	info->flags 		= header[5];
+	info->fecParity 	= header[6];
+	info->matrixK 		= header[7];
+	info->length 		= toUInt(&header[8]);
+	info->storedLength 	= toUInt(&header[12]);
+	info->checksum 		= toUInt(&header[16]);
+	info->corrected 	= 0;
+
+	if(info->flags & PAYLOAD_FLAG_ADAPTIVE){
+		info->threshold = info->storedLength;
+		info->storedLength = storedSize(info->length, info);
+		if(info->threshold >= ADAPTIVE_CLASSES)
+			return 0;
+	}
+
+	//The header must describe a payload that could have been
+	//embedded to this area.
+	if(!validOptions(info) || info->storedLength != storedSize(info->length, info)
+		|| info->storedLength > bodyCapacity(areaSize + bodyShift(info), info))
+		return 0;
+
+	info->error = PAYLOAD_OK;
+	return 1;
+}
+
+int embedPayload(uint8_t* area, unsigned int areaSize, uint8_t* payload, uint32_t length, PAYLOAD_INFO* info){
+	rsInit();
+	initSyndromeMasks();
+
+	if(!validOptions(info)){
+		info->error = PAYLOAD_INVALID_OPTIONS;
+		return 0;
+	}
+	if(length > payloadCapacity(areaSize, info)){
+		info->error = PAYLOAD_TOO_LARGE;
+		return 0;
+	}
+
+	info->length = length;
+	info->storedLength = storedSize(length, info);
+	info->checksum = crc32c(0, payload, length);
+	info->corrected = 0;
+
+	uint8_t* stored = payload;
+
+	if(info->flags & PAYLOAD_FLAG_FEC){
+		if((stored = malloc(info->storedLength)) == NULL){
+			info->error = PAYLOAD_MEMORY_ERROR;
+			return 0;
+		}
+		fecEncode(payload, length, info->fecParity, stored);
+	}
+
+	if(info->flags & PAYLOAD_FLAG_ADAPTIVE){
+		info->threshold = chooseThreshold(area, areaSize, info->rowBytes, info->storedLength);
+		adaptiveStored(area, areaSize, stored, info->storedLength, info, 1);
+	}
+	else
+		embedStored(area, 0, stored, 0, info->storedLength, info);
+	writePayloadHeader(area, info);
+
+	if(stored != payload)
+		free(stored);
+
+	info->error = PAYLOAD_OK;
+	return 1;
+}
+
+uint8_t* extractPayload(uint8_t* area, unsigned int areaSize, PAYLOAD_INFO* info){
+	if(!readPayloadHeader(area, areaSize, info))
+		return NULL;
+
+	uint8_t* stored = malloc(info->storedLength + 1);
+	if(stored == NULL){
+		info->error = PAYLOAD_MEMORY_ERROR;
+		return NULL;
+	}
+
+	//Without FEC the stored bytes are the payload itself, and the
+	//checksum is updated while extracting.
+	if(!(info->flags & PAYLOAD_FLAG_FEC)){
+		uint32_t crc = 0;
+
+		if(info->flags & PAYLOAD_FLAG_ADAPTIVE){
+			adaptiveStored(area, areaSize, stored, info->length, info, 0);
+			crc = crc32c(0, stored, info->length);
+		}
+		else for(uint32_t i = 0; i < info->length; i += CHECKSUM_CHUNK){
+			uint32_t count = info->length - i < CHECKSUM_CHUNK ? info->length - i : CHECKSUM_CHUNK;
+			extractStored(area, bodyShift(info), &stored[i], i, count, info);
+			crc = crc32c(crc, &stored[i], count);
+		}
+		if(crc != info->checksum){
+			free(stored);
+			info->error = PAYLOAD_CHECKSUM_ERROR;
+			return NULL;
+		}
+
+		stored[info->length] = '\0';
+		info->error = PAYLOAD_OK;
+		return stored;
+	}
+	if(info->flags & PAYLOAD_FLAG_ADAPTIVE)
+		adaptiveStored(area, areaSize, stored, info->storedLength, info, 0);
+	else
+		extractStored(area, bodyShift(info), stored, 0, info->storedLength, info);
+
+	uint8_t* payload = malloc(info->length + 1);
+	if(payload == NULL){
+		free(stored);
+		info->error = PAYLOAD_MEMORY_ERROR;
+		return NULL;
+	}
+
+	uint32_t crc;
+	int fixed = fecDecode(stored, info->length, info->fecParity, payload, &crc);
+	free(stored);
+
+	if(fixed < 0){
+		free(payload);
+		info->error = PAYLOAD_UNCORRECTABLE;
+		return NULL;
+	}
+	info->corrected = fixed;
+
+	if(crc != info->checksum){
+		free(payload);
+		info->error = PAYLOAD_CHECKSUM_ERROR;
+		return NULL;
+	}
+
+	payload[info->length] = '\0';
+	info->error = PAYLOAD_OK;
+	return payload;
+}
+
+//Extracts the stored bytes [first, first + count) from the source.
+static int sourceStored(PAYLOAD_SOURCE* source, uint8_t* bytes, uint32_t first, uint32_t count, PAYLOAD_INFO* info){
+	uint32_t base = bodyShift(info);
+
+	if(source->area != NULL){
+		extractStored(source->area, base, bytes, first, count, info);
+		return 1;
+	}
+
+	while(count > 0){
+		uint32_t amount = count < RANGE_CHUNK ? count : RANGE_CHUNK,
+				 start, end;
+
+		payloadSpan(info, first, amount, &start, &end);
+		start -= base;
+		end -= base;
+
+		uint8_t* window = malloc(end - start);
+		if(window == NULL){
+			info->error = PAYLOAD_MEMORY_ERROR;
+			return 0;
+		}
+		if(!source->read(source->handle, window, start, end - start)){
+			free(window);
+			info->error = PAYLOAD_READ_ERROR;
+			return 0;
+		}
+		extractStored(window, start + base, bytes, first, amount, info);
+		free(window);
+
+		bytes += amount;
+		first += amount;
+		count -= amount;
+	}
+	return 1;
+}
+
+int extractRange(PAYLOAD_SOURCE* source, uint8_t* bytes, uint32_t first, uint32_t count, PAYLOAD_INFO* info){
+	rsInit();
+	initSyndromeMasks();
+
+	if(first > info->length || count > info->length - first){
+		info->error = PAYLOAD_OUT_OF_RANGE;
+		return 0;
+	}
+	if(info->flags & PAYLOAD_FLAG_ADAPTIVE){
+		info->error = PAYLOAD_NOT_SEEKABLE;
+		return 0;
+	}
+
+	//An empty range, or an empty payload, holds no codewords.
+	if(count == 0 || info->length == 0){
+		info->error = PAYLOAD_OK;
+		return 1;
+	}
+
+	if(!(info->flags & PAYLOAD_FLAG_FEC)){
+		if(!sourceStored(source, bytes, first, count, info))
+			return 0;
+
+		info->error = PAYLOAD_OK;
+		return 1;
+	}
+
+	//Only the codewords holding the range are extracted. Byte j of
+	//codeword b is stored at j * blocks + b, so byte j of all the
+	//needed codewords is a run of stored bytes read at once, and the
+	//codewords are put together from the runs.
+	int parity = info->fecParity;
+	uint32_t blocks, blockData;
+	uint8_t codeword[RS_MAX_CODEWORD];
+
+	codewordLayout(info->length, parity, &blocks, &blockData);
+
+	uint32_t firstBlock = first / blockData,
+			 needed = (first + count - 1) / blockData - firstBlock + 1,
+			 n = blockData + parity;
+
+	uint8_t* runs = malloc((size_t) needed * n);
+	if(runs == NULL){
+		info->error = PAYLOAD_MEMORY_ERROR;
+		return 0;
+	}
+	for(uint32_t j = 0; j < n; j++)
+		if(!sourceStored(source, &runs[(size_t) j * needed], j * blocks + firstBlock, needed, info)){
+			free(runs);
+			return 0;
+		}
+
+	for(uint32_t b = firstBlock; count > 0; b++){
+		for(uint32_t j = 0; j < n; j++)
+			codeword[j] = runs[(size_t) j * needed + b - firstBlock];
+
+		int fixed = rsDecode(codeword, n, parity);
+		if(fixed < 0){
+			free(runs);
+			info->error = PAYLOAD_UNCORRECTABLE;
+			return 0;
+		}
+		info->corrected += fixed;
+
+		uint32_t offset = first - b * blockData,
+				 amount = blockData - offset < count ? blockData - offset : count;
+		memcpy(bytes, &codeword[offset], amount);
+
+		bytes += amount;
+		first += amount;
+		count -= amount;
+	}
+	free(runs);
+
+	info->error = PAYLOAD_OK;
+	return 1;
+}
+
+int appendPayload(uint8_t* window, uint32_t windowStart, unsigned int areaSize,
+	uint8_t* payload, uint32_t length, PAYLOAD_INFO* info){
+
+	initSyndromeMasks();
+
+	if(info->flags & (PAYLOAD_FLAG_FEC | PAYLOAD_FLAG_CONTAINER | PAYLOAD_FLAG_ADAPTIVE)){
+		info->error = PAYLOAD_NOT_APPENDABLE;
+		return 0;
+	}
+	if(length > payloadCapacity(areaSize, info) - info->length){
+		info->error = PAYLOAD_TOO_LARGE;
+		return 0;
+	}
+
+	embedStored(window, windowStart, payload, info->length, length, info);
+
+	//The checksum of the whole payload is continued from the old one.
+	info->checksum = crc32c(info->checksum, payload, length);
+	info->length += length;
+	info->storedLength = info->length;
+	info->error = PAYLOAD_OK;
+	return 1;
+}
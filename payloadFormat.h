@@ -0,0 +1,545 @@
+#include <stdint.h>
+/*
+Purpose:
+	This modul handles the headered payload format.
+	Unlike the encodeData()-function in the bitModul,
+	the functions in this modul store a small header
+	before the actual payload. The header tells how
+	the payload was encoded so that the decoder can
+	select the matching path, and also stores the exact
+	lenght of the payload so any binary data can be
+	encoded.
+	The header itself is always encoded with the
+	encode()-function to the beginning of the data area,
+	and is protected with Reed-Solomon parity and a
+	checksum of its own.
+	The header also stores a CRC32C checksum of the
+	payload. The checksum is verified while the payload
+	is extracted, so a damaged or truncated payload is
+	reported instead of being returned.
+
+	The payload can be embedded either by changing the
+	last bit of 8 bytes for each byte of payload like the
+	encode()-function does, or with matrix embedding. Matrix
+	embedding uses the [2^k - 1, k] Hamming code: each block
+	of 2^k - 1 bytes carries k bits of payload and atmost
+	one byte of the block is changed. This changes far fewer
+	bytes of the image at the cost of a lower capacity.
+
+	Instead of using the data area from the beginning,
+	the payload can also be embedded adaptively: only to
+	the blocks of the image with the most texture, where
+	the changes are the hardest to detect. The texture is
+	counted without the last bits of the bytes, so the
+	decoder finds the same blocks from the encoded image.
+
+	Optionally the payload can be protected with
+	Reed-Solomon forward error correction. The payload is
+	then split to codewords wich are interleaved before
+	encoding, so that damage to a continuous area of the
+	image is spread over several codewords.
+
+	Any range of the payload can be extracted without
+	extracting the bytes before it. The data can be given
+	either in memory or as a function reading the needed
+	data bytes, so only the parts of a file holding the
+	range have to be read. This works for all the ways a
+	payload can be embedded, and also for data encoded
+	with the encodeData()-function, but not for adaptive
+	embedding wich needs the whole data area.
+
+Functions:
+	void payloadInit()
+	unsigned int payloadCapacity(unsigned int, PAYLOAD_INFO*)
+	int readPayloadHeader(uint8_t*, unsigned int, PAYLOAD_INFO*)
+	int embedPayload(uint8_t*, unsigned int, uint8_t*, uint32_t, PAYLOAD_INFO*)
+	uint8_t* extractPayload(uint8_t*, unsigned int, PAYLOAD_INFO*)
+	void payloadSpan(PAYLOAD_INFO*, uint32_t, uint32_t, uint32_t*, uint32_t*)
+	unsigned int payloadAreaSize(uint32_t, PAYLOAD_INFO*)
+	void writePayloadHeader(uint8_t*, PAYLOAD_INFO*)
+	int appendPayload(uint8_t*, uint32_t, unsigned int, uint8_t*, uint32_t, PAYLOAD_INFO*)
+	int extractRange(PAYLOAD_SOURCE*, uint8_t*, uint32_t, uint32_t, PAYLOAD_INFO*)
+	uint32_t fecSize(uint32_t, int)
+	void fecEncode(uint8_t*, uint32_t, int, uint8_t*)
+	int fecDecode(uint8_t*, uint32_t, int, uint8_t*, uint32_t*)
+
+Dependancies:
+	Uses the bitModul, the reedSolomon and the checksum modul.
+*/
+
+//The version of the header written by this modul.
+#define HEADER_VERSION 2
+
+//The amount of bytes in the header fields.
+#define HEADER_FIELDS 24
+
+//The amount of Reed-Solomon parity bytes protecting the header.
+#define HEADER_PARITY 8
+
+//The amount of bytes in the whole header.
+#define HEADER_SIZE (HEADER_FIELDS + HEADER_PARITY)
+
+//The amount of bitmap data bytes needed for encoding the header.
+#define HEADER_AREA (HEADER_SIZE * 8)
+
+//The default amount of parity bytes per codeword.
+#define DEFAULT_FEC_PARITY 16
+
+//The largest amount of parity bytes per codeword, leaving atleast
+//half of a codeword for the data.
+#define MAX_FEC_PARITY 128
+
+//The smallest and the largest k supported by matrix embedding.
+#define MATRIX_MIN_K 2
+#define MATRIX_MAX_K 6
+
+//The default k used by matrix embedding.
+#define DEFAULT_MATRIX_K 4
+
+//The flag telling that the payload is protected with FEC.
+#define PAYLOAD_FLAG_FEC 0x01
+
+//The flag telling that the payload is embedded with matrix embedding.
+#define PAYLOAD_FLAG_MATRIX 0x02
+
+//The flag telling that the payload is a container of several entries.
+#define PAYLOAD_FLAG_CONTAINER 0x04
+
+//The flag telling that the payload is embedded only to the blocks
+//of the image with the most texture.
+#define PAYLOAD_FLAG_ADAPTIVE 0x08
+
+//The width and the height of the blocks used by adaptive embedding
+//in pixels.
+#define ADAPTIVE_BLOCK 16
+
+//The amount of texture classes the blocks are divided to.
+#define ADAPTIVE_CLASSES 4096
+
+//The flag telling that the data is encoded with the encodeData()-
+//function. This flag is never stored to a header, it is only used
+//with the extractRange()-function.
+#define PAYLOAD_FLAG_LEGACY 0x80
+
+/********************************************
+Enum: PAYLOAD_ERROR
+
+Purpose: The different error conditions the functions
+	 of this modul can run into. The value is stored
+	 to the error variable of the PAYLOAD_INFO struct
+	 given to the functions.
+********************************************/
+typedef enum{
+	PAYLOAD_OK,					//No error
+	PAYLOAD_NO_HEADER,			//The data area has no valid header
+	PAYLOAD_TOO_LARGE,			//The payload does not fit to the data area
+	PAYLOAD_INVALID_OPTIONS,	//The embedding options are not valid
+	PAYLOAD_UNCORRECTABLE,		//The payload had too many errors to be corrected
+	PAYLOAD_MEMORY_ERROR,		//A malloc operation returned NULL
+	PAYLOAD_NOT_APPENDABLE,		//The payload is encoded in a way that can not be appended to
+	PAYLOAD_CHECKSUM_ERROR,		//The extracted payload does not match its checksum
+	PAYLOAD_OUT_OF_RANGE,		//The requested bytes are not within the payload
+	PAYLOAD_READ_ERROR,			//Reading the data from the source failed
+	PAYLOAD_NOT_SEEKABLE		//The payload can only be extracted as a whole
+}PAYLOAD_ERROR;
+
+/********************************************
+Struct: PAYLOAD_INFO
+
+Purpose: Holds the options used for embedding a payload,
+	 or the options read from the header of an embedded
+	 payload.
+
+Usage: Before embedding set the flags, the fecParity and
+       the matrixK variables, the rest of the variables are filled by
+       the functions of this modul.
+       A struct initialized to zero embeds the payload
+       without FEC.
+       The rowBytes variable must be set to the lenght of a row of
+       the data area (the width of the image times 3) before embedding
+       or reading a header, since adaptive embedding needs to know
+       where the blocks are. It is never overwritten.
+********************************************/
+typedef struct{
+	uint8_t  flags;			//The PAYLOAD_FLAG values used
+	uint8_t  fecParity;		//Parity bytes per codeword, used with PAYLOAD_FLAG_FEC
+	uint8_t  matrixK;		//Bits per block, used with PAYLOAD_FLAG_MATRIX
+	uint32_t length;		//The lenght of the payload in bytes
+	uint32_t storedLength;	//The lenght of the payload after FEC encoding
+	uint32_t checksum;		//The CRC32C checksum of the payload
+	uint32_t corrected;		//The amount of bytes corrected while extracting
+	uint32_t threshold;		//The lowest texture class used, with PAYLOAD_FLAG_ADAPTIVE
+	uint32_t rowBytes;		//The lenght of a row of the data area
+
+	PAYLOAD_ERROR error;	//The error in the last operation
+}PAYLOAD_INFO;
+
+/********************************************
+Struct: PAYLOAD_SOURCE
+
+Purpose: Tells the extractRange()-function where the data
+	 area is read from.
+
+Usage: If the data area is in memory set the area variable
+       to point to it. Otherwise set the area variable to NULL
+       and the read variable to a function reading the data
+       bytes [start, start + lenght) of the data area to the
+       given buffer and returning 1 on success, 0 otherwise.
+       The handle is given to the read function as is.
+********************************************/
+typedef struct{
+	uint8_t* area;												//The data area or NULL
+	int (*read)(void* handle, uint8_t* buffer, uint32_t start, uint32_t length);	//Reads a part of the data area
+	void* handle;												//Given to the read function
+}PAYLOAD_SOURCE;
+
+/********************************************
+Function: payloadInit()
+
+Purpose: Builds the tables used by this modul and by the
+	 reedSolomon and the checksum moduls. The functions of
+	 this modul build the tables when needed, but this
+	 function is not thread safe, so call it once before
+	 starting any threads.
+
+Inputs: Nothing.
+
+Returns: Nothing.
+
+Modifies: The internal tables of the moduls. Calling this
+	  function more than once does nothing.
+
+Error checking: None.
+
+Sample call: payloadInit();
+********************************************/
+void payloadInit();
+
+/********************************************
+Function: payloadCapacity(unsigned int, PAYLOAD_INFO*)
+
+Purpose: Counts the lenght of the longest payload that can
+	 be embedded to a data area of the given size with
+	 the given options.
+
+Inputs: The size of the data area in bytes and the options
+	to be used.
+
+Returns: The maximum payload lenght in bytes. 0 if not even
+	 the header fits to the data area.
+
+Modifies: Nothing.
+
+Error checking: None.
+
+Sample call: unsigned int max = payloadCapacity(dataSize(file), &info);
+********************************************/
+unsigned int payloadCapacity(unsigned int, PAYLOAD_INFO*);
+
+/********************************************
+Function: readPayloadHeader(uint8_t*, unsigned int, PAYLOAD_INFO*)
+
+Purpose: Reads and validates the header from the beginning
+	 of the given data area.
+
+Inputs: The data area, the size of the data area and the
+	struct where the header values should be stored.
+	Only the first HEADER_AREA bytes of the data area are
+	read, so the header can also be read from a partially
+	loaded data area as long as the full size is given.
+
+Returns: 1 if a valid header was found, 0 otherwise.
+	 The data areas encoded with the encodeData()-function
+	 do not have a header.
+
+Modifies: Overwrites the values in the given struct, except
+	  the rowBytes variable.
+
+Error checking: Checks the magic bytes, the version, the checksum
+		of the header and that the lenghts in the header fit
+		to the data area. Errors in the header are corrected
+		if possible.
+
+Sample call: if(readPayloadHeader(file->data, dataSize(file), &info))
+		...headered payload...
+	     else
+		...no header...
+********************************************/
+int readPayloadHeader(uint8_t*, unsigned int, PAYLOAD_INFO*);
+
+/********************************************
+Function: embedPayload(uint8_t*, unsigned int, uint8_t*, uint32_t, PAYLOAD_INFO*)
+
+Purpose: Embeds the header and the given payload to the
+	 given data area.
+
+Inputs: The data area, the size of the data area, the payload,
+	the lenght of the payload and the options to be used.
+	Only the first payloadAreaSize() bytes of the data area
+	are modified.
+	With PAYLOAD_FLAG_ADAPTIVE the whole data area is read
+	twice: first to choose the texture threshold so that the
+	blocks at or above it can hold the payload, and then to
+	embed the payload to those blocks.
+
+Returns: 1 on success 0 otherwise.
+	 If 0 was returned the error variable in the given
+	 struct tells the reason.
+
+Modifies: Overwrites the last bits of the bytes in the data
+	  area. Fills the lenght variables of the given struct.
+
+Error checking: Reports an error if:
+		the payload does not fit to the data area,
+		the FEC parity is not an even number between 2 and 128,
+		adaptive embedding is combined with matrix embedding
+		or with entries,
+		the matrix k is not between MATRIX_MIN_K and MATRIX_MAX_K,
+		the memory allocation for the FEC encoding failed.
+
+Sample call: PAYLOAD_INFO info = {0};
+	     info.flags = PAYLOAD_FLAG_FEC;
+	     info.fecParity = 16;
+	     if(!embedPayload(file->data, dataSize(file), msg, len, &info))
+		...failure...
+********************************************/
+int embedPayload(uint8_t*, unsigned int, uint8_t*, uint32_t, PAYLOAD_INFO*);
+
+/********************************************
+Function: extractPayload(uint8_t*, unsigned int, PAYLOAD_INFO*)
+
+Purpose: Extracts a payload embedded with the embedPayload()-
+	 function from the given data area. If the payload is
+	 protected with FEC the errors in it are corrected.
+
+Inputs: The data area, the size of the data area and the struct
+	where the header values should be stored.
+
+Returns: A pointer to the extracted payload or NULL on failure.
+	 The lenght of the payload is stored to the given struct.
+	 For convenience the payload is followed by an extra
+	 null-character not counted in the lenght.
+
+Modifies: Reserves memory for the returned payload, you must free
+	  this memory later by yourself.
+
+Error checking: Reports an error if:
+		the data area has no valid header,
+		the payload has too many errors to be corrected,
+		the payload does not match the checksum in the header,
+		a memory allocation failed.
+
+Sample call: uint8_t* msg = extractPayload(file->data, dataSize(file), &info);
+********************************************/
+uint8_t* extractPayload(uint8_t*, unsigned int, PAYLOAD_INFO*);
+
+/********************************************
+Function: payloadSpan(PAYLOAD_INFO*, uint32_t, uint32_t, uint32_t*, uint32_t*)
+
+Purpose: Tells wich bytes of the data area hold the given
+	 range of stored bytes (the payload after FEC encoding).
+
+Inputs: The options the payload is embedded with, the index of
+	the first stored byte, the amount of stored bytes and
+	pointers where the start and the end of the data area
+	span are stored.
+
+Returns: Nothing.
+
+Modifies: Overwrites the values pointed by the last two arguments.
+	  The span is given as [start, end).
+
+Error checking: None.
+
+Sample call: uint32_t start, end;
+	     payloadSpan(&info, info.length, 100, &start, &end);
+********************************************/
+void payloadSpan(PAYLOAD_INFO*, uint32_t, uint32_t, uint32_t*, uint32_t*);
+
+/********************************************
+Function: payloadAreaSize(uint32_t, PAYLOAD_INFO*)
+
+Purpose: Counts how many bytes from the beginning of the data
+	 area are used when a payload of the given lenght is
+	 embedded with the given options.
+
+Inputs: The lenght of the payload and the options.
+
+Returns: The amount of data bytes used, including the header.
+	 With PAYLOAD_FLAG_ADAPTIVE the blocks used depend on the
+	 image, so UINT32_MAX is returned, meaning the whole data
+	 area.
+
+Modifies: Nothing.
+
+Error checking: None.
+
+Sample call: unsigned int used = payloadAreaSize(len, &info);
+********************************************/
+unsigned int payloadAreaSize(uint32_t, PAYLOAD_INFO*);
+
+/********************************************
+Function: writePayloadHeader(uint8_t*, PAYLOAD_INFO*)
+
+Purpose: Encodes the header described by the given struct
+	 to the beginning of the given data area.
+
+Inputs: The data area, wich must have atleast HEADER_AREA
+	bytes, and the header values.
+
+Returns: Nothing.
+
+Modifies: Overwrites the last bits of the first HEADER_AREA
+	  bytes of the data area.
+
+Error checking: None.
+
+Sample call: writePayloadHeader(headerArea, &info);
+********************************************/
+void writePayloadHeader(uint8_t*, PAYLOAD_INFO*);
+
+/********************************************
+Function: appendPayload(uint8_t*, uint32_t, unsigned int, uint8_t*, uint32_t, PAYLOAD_INFO*)
+
+Purpose: Appends the given bytes after an allready embedded
+	 payload. Only the data bytes after the current payload
+	 are touched so the cost depends only on the lenght of
+	 the appended bytes.
+	 The header is not rewritten by this function, after
+	 the appended bytes have been stored the header should
+	 be updated with the writePayloadHeader()-function.
+
+Inputs: A window of the data area, the index of the first data
+	byte in the window, the size of the whole data area, the
+	bytes to be appended, the amount of bytes to be appended
+	and the header of the current payload.
+	The window must cover the span given by
+	payloadSpan(info, info->length, length, ...).
+
+Returns: 1 on success 0 otherwise.
+	 If 0 was returned the error variable in the given
+	 struct tells the reason.
+
+Modifies: Overwrites the last bits of the bytes in the window
+	  and updates the lenghts and the checksum in the given
+	  struct.
+
+Error checking: Reports an error if:
+		the payload is protected with FEC (the codewords
+		would need to be recomputed),
+		the payload is embedded adaptively or holds entries,
+		the appended bytes do not fit to the data area.
+
+Sample call: payloadSpan(&info, info.length, len, &start, &end);
+	     ...read data bytes [start, end) to window...
+	     if(appendPayload(window, start, dataSize(file), msg, len, &info))
+		writePayloadHeader(headerArea, &info);
+********************************************/
+int appendPayload(uint8_t*, uint32_t, unsigned int, uint8_t*, uint32_t, PAYLOAD_INFO*);
+
+/********************************************
+Function: extractRange(PAYLOAD_SOURCE*, uint8_t*, uint32_t, uint32_t, PAYLOAD_INFO*)
+
+Purpose: Extracts the payload bytes [first, first + count)
+	 without extracting the bytes before them. Only the data
+	 bytes holding the range are read from the source.
+	 If the payload is protected with FEC, only the codewords
+	 holding the range are extracted and corrected.
+	 The checksum of the payload is not verified, since only
+	 a part of the payload is extracted.
+
+Inputs: The source of the data area, the buffer where the bytes
+	should be stored, the index of the first payload byte, the
+	amount of bytes and the header of the payload.
+	For data encoded with the encodeData()-function set the
+	flags of the struct to PAYLOAD_FLAG_LEGACY and the lenght
+	to the size of the data area divided by 8.
+
+Returns: 1 on success 0 otherwise.
+	 If 0 was returned the error variable in the given
+	 struct tells the reason.
+
+Modifies: Overwrites count bytes of the given buffer. Adds the
+	  amount of corrected bytes to the corrected variable of
+	  the given struct.
+
+Error checking: Reports an error if:
+		the range is not within the payload,
+		the payload is embedded adaptively (the blocks
+		before the range must be found first, so use the
+		extractPayload()-function instead),
+		the source could not be read,
+		a codeword has too many errors to be corrected,
+		a memory allocation failed.
+
+Sample call: PAYLOAD_SOURCE source = {NULL, readFunction, file};
+	     if(extractRange(&source, bytes, 1000, 100, &info))
+		...bytes 1000 - 1099 of the payload...
+********************************************/
+int extractRange(PAYLOAD_SOURCE*, uint8_t*, uint32_t, uint32_t, PAYLOAD_INFO*);
+
+/********************************************
+Function: fecSize(uint32_t, int)
+
+Purpose: Counts the lenght of the given amount of bytes after
+	 they are encoded with the fecEncode()-function.
+
+Inputs: The lenght of the data and the amount of parity bytes
+	per codeword.
+
+Returns: The lenght of the encoded data.
+
+Modifies: Nothing.
+
+Error checking: None.
+
+Sample call: uint8_t* stored = malloc(fecSize(len, 16));
+********************************************/
+uint32_t fecSize(uint32_t, int);
+
+/********************************************
+Function: fecEncode(uint8_t*, uint32_t, int, uint8_t*)
+
+Purpose: Protects the given data with Reed-Solomon codewords
+	 interleaved the same way as the codewords of a payload
+	 embedded with PAYLOAD_FLAG_FEC.
+
+Inputs: The data, the lenght of the data, the amount of parity
+	bytes per codeword (an even number between 2 and 128) and
+	the buffer where the encoded data should be stored.
+	The buffer must have space for fecSize() bytes.
+
+Returns: Nothing.
+
+Modifies: Overwrites the given buffer.
+
+Error checking: None.
+
+Sample call: fecEncode(data, len, 16, stored);
+********************************************/
+void fecEncode(uint8_t*, uint32_t, int, uint8_t*);
+
+/********************************************
+Function: fecDecode(uint8_t*, uint32_t, int, uint8_t*, uint32_t*)
+
+Purpose: Corrects and decodes data encoded with the
+	 fecEncode()-function.
+
+Inputs: The encoded data, the lenght of the original data, the
+	amount of parity bytes per codeword, the buffer where the
+	original data should be stored and a pointer where the
+	CRC32C checksum of the decoded data is stored.
+
+Returns: The amount of corrected bytes, or -1 if some codeword
+	 had too many errors to be corrected.
+
+Modifies: Overwrites the given buffer and the checksum.
+
+Error checking: Each corrected codeword is checked to be
+		a valid codeword.
+
+Sample call: uint32_t crc;
+	     if(fecDecode(stored, len, 16, data, &crc) < 0 || crc != expected)
+		...failure...
+********************************************/
+int fecDecode(uint8_t*, uint32_t, int, uint8_t*, uint32_t*);
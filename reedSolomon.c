@@ -0,0 +1,196 @@
+#include <string.h>
+#include "reedSolomon.h"
+
+//The primitive polynomial x^8 + x^4 + x^3 + x^2 + 1
+#define PRIMITIVE 0x11D
+
+static uint8_t gfExp[512];
+static uint8_t gfLog[256];
+static uint8_t gfMulTable[256][256];
+static int initialized = 0;
+
+void rsInit(){
+	if(initialized)
+		return;
+
+	int x = 1;
+	for(int i = 0; i < 255; i++){
+		gfExp[i] = (uint8_t) x;
+		gfLog[x] = (uint8_t) i;
+		x <<= 1;
+		if(x & 0x100)
+			x ^= PRIMITIVE;
+	}
+	//The exponent table is doubled so that sums of two
+	//logarithms can be used as an index without a modulo.
+	for(int i = 255; i < 512; i++)
+		gfExp[i] = gfExp[i - 255];
+
+	for(int a = 0; a < 256; a++){
+		for(int b = 0; b < 256; b++){
+			if(a == 0 || b == 0)
+				gfMulTable[a][b] = 0;
+			else
+				gfMulTable[a][b] = gfExp[gfLog[a] + gfLog[b]];
+		}
+	}
+	initialized = 1;
+}
+
+uint8_t gfMul(uint8_t a, uint8_t b){
+	return gfMulTable[a][b];
+}
+
+static uint8_t gfInverse(uint8_t a){
+	return gfExp[255 - gfLog[a]];
+}
+
+//Evaluates a polynomial stored lowest degree first.
+static uint8_t evalLow(uint8_t* poly, int degree, uint8_t x){
+	uint8_t* row = gfMulTable[x];
+	uint8_t y = 0;
+
+	for(int i = degree; i >= 0; i--)
+		y = row[y] ^ poly[i];
+
+	return y;
+}
+
+void rsGenerator(int nsym, uint8_t* gen){
+	int len = 1;
+	gen[0] = 1;
+
+	//gen = (x - a^0)(x - a^1)...(x - a^(nsym - 1))
+	for(int j = 0; j < nsym; j++){
+		uint8_t* row = gfMulTable[gfExp[j]];
+		gen[len] = 0;
+		for(int i = len; i > 0; i--)
+			gen[i] ^= row[gen[i - 1]];
+		len++;
+	}
+}
+
+void rsEncode(uint8_t* message, int length, uint8_t* gen, int nsym, uint8_t* parity){
+	memset(parity, 0, nsym);
+
+	//Polynomial division done as a shift register, the
+	//remainder of the division is the parity.
+	for(int i = 0; i < length; i++){
+		uint8_t* row = gfMulTable[message[i] ^ parity[0]];
+		for(int j = 0; j < nsym - 1; j++)
+			parity[j] = parity[j + 1] ^ row[gen[j + 1]];
+		parity[nsym - 1] = row[gen[nsym]];
+	}
+}
+
+//Computes the syndromes of the codeword. Returns 1 if
+//any of them is non-zero, e.g. the codeword has errors.
+static int syndromes(uint8_t* codeword, int length, int nsym, uint8_t* synd){
+	int errors = 0;
+
+	for(int j = 0; j < nsym; j++){
+		uint8_t* row = gfMulTable[gfExp[j]];
+		uint8_t s = 0;
+		for(int i = 0; i < length; i++)
+			s = row[s] ^ codeword[i];
+		synd[j] = s;
+		errors |= s;
+	}
+	return errors != 0;
+}
+
+int rsDecode(uint8_t* codeword, int length, int nsym){
+	uint8_t synd[RS_MAX_PARITY];
+
+	if(!syndromes(codeword, length, nsym, synd))
+		return 0;
+
+	//Berlekamp-Massey, all polynomials are stored lowest degree first.
+	uint8_t locator[RS_MAX_PARITY + 1] = {1},
+		previous[RS_MAX_PARITY + 1] = {1},
+		temp[RS_MAX_PARITY + 1];
+	int errors = 0, shift = 1;
+	uint8_t lastDelta = 1;
+
+	for(int r = 0; r < nsym; r++){
+		uint8_t delta = synd[r];
+		for(int i = 1; i <= errors; i++)
+			delta ^= gfMulTable[locator[i]][synd[r - i]];
+
+		if(delta == 0){
+			shift++;
+			continue;
+		}
+
+		uint8_t scale = gfMulTable[delta][gfInverse(lastDelta)];
+		if(2 * errors <= r){
+			memcpy(temp, locator, sizeof(temp));
+			for(int i = 0; i + shift <= nsym; i++)
+				locator[i + shift] ^= gfMulTable[scale][previous[i]];
+			errors = r + 1 - errors;
+			memcpy(previous, temp, sizeof(previous));
+			lastDelta = delta;
+			shift = 1;
+		}
+		else{
+			for(int i = 0; i + shift <= nsym; i++)
+				locator[i + shift] ^= gfMulTable[scale][previous[i]];
+			shift++;
+		}
+	}
+	if(2 * errors > nsym)
+		return -1;
+
+	//Chien search: the byte at index k is erroneous if the
+	//locator has a root at a^-(length - 1 - k).
+	int positions[RS_MAX_PARITY];
+	int found = 0;
+	for(int k = 0; k < length; k++){
+		int power = length - 1 - k;
+		if(evalLow(locator, errors, gfExp[(255 - power) % 255]) == 0){
+			if(found == errors)
+				return -1;
+			positions[found++] = k;
+		}
+	}
+	if(found != errors)
+		return -1;
+
+	//Forney: the error evaluator is synd(x) * locator(x) mod x^nsym
+	uint8_t evaluator[RS_MAX_PARITY];
+	for(int i = 0; i < nsym; i++){
+		uint8_t e = 0;
+		for(int j = 0; j <= i && j <= errors; j++)
+			e ^= gfMulTable[locator[j]][synd[i - j]];
+		evaluator[i] = e;
+	}
+
+	uint8_t corrected[RS_MAX_CODEWORD];
+	memcpy(corrected, codeword, length);
+
+	for(int e = 0; e < found; e++){
+		int power = length - 1 - positions[e];
+		uint8_t x = gfExp[power],
+			xInverse = gfExp[(255 - power) % 255];
+
+		//The formal derivative of the locator evaluated at xInverse.
+		uint8_t derivative = 0, xPower = 1,
+			xSquared = gfMulTable[xInverse][xInverse];
+		for(int i = 1; i <= errors; i += 2){
+			derivative ^= gfMulTable[locator[i]][xPower];
+			xPower = gfMulTable[xPower][xSquared];
+		}
+		if(derivative == 0)
+			return -1;
+
+		uint8_t magnitude = gfMulTable[x][evalLow(evaluator, nsym - 1, xInverse)];
+		corrected[positions[e]] ^= gfMulTable[magnitude][gfInverse(derivative)];
+	}
+
+	//The correction is accepted only if it produced a valid codeword.
+	if(syndromes(corrected, length, nsym, synd))
+		return -1;
+
+	memcpy(codeword, corrected, length);
+	return found;
+}
@@ -0,0 +1,137 @@
+#include <stdint.h>
+/*
+Purpose:
+	This modul contains a Reed-Solomon coder working
+	over the Galois field GF(256). It is used for adding
+	forward error correction to the data encoded within
+	bitmaps so that a few flipped bits can be repaired
+	while decoding.
+	All the multiplications are done through a precomputed
+	256 x 256 table so that no logarithms are needed in
+	the inner loops.
+
+Functions:
+	void rsInit()
+	uint8_t gfMul(uint8_t, uint8_t)
+	void rsGenerator(int, uint8_t*)
+	void rsEncode(uint8_t*, int, uint8_t*, int, uint8_t*)
+	int rsDecode(uint8_t*, int, int)
+
+Dependancies: None.
+*/
+
+//The largest amount of bytes a single codeword can have.
+#define RS_MAX_CODEWORD 255
+
+//The largest amount of parity bytes a single codeword can have.
+#define RS_MAX_PARITY 254
+
+/********************************************
+Function: rsInit()
+
+Purpose: Builds the logarithm, exponent and multiplication
+	 tables used by the other functions of this modul.
+
+Inputs: Nothing.
+
+Returns: Nothing.
+
+Modifies: The internal tables of this modul. Calling this
+	  function more than once does nothing.
+	  This function is not thread safe, call it once before
+	  starting any threads.
+
+Error checking: None.
+
+Sample call: rsInit();
+********************************************/
+void rsInit();
+
+/********************************************
+Function: gfMul(uint8_t, uint8_t)
+
+Purpose: Multiplies two elements of GF(256).
+
+Inputs: The two elements to be multiplied.
+	rsInit() must have been called before this.
+
+Returns: The product of the given elements.
+
+Modifies: Nothing.
+
+Error checking: None.
+
+Sample call: uint8_t p = gfMul(a, b);
+********************************************/
+uint8_t gfMul(uint8_t, uint8_t);
+
+/********************************************
+Function: rsGenerator(int, uint8_t*)
+
+Purpose: Computes the generator polynomial for codewords
+	 with the given amount of parity bytes.
+
+Inputs: The amount of parity bytes (1 - RS_MAX_PARITY) and
+	a memory area where the polynomial is stored.
+	The memory area MUST HAVE SPACE FOR ATLEAST
+	parity + 1 bytes. The highest degree coefficient
+	will be stored first.
+
+Returns: Nothing.
+
+Modifies: Overwrites the given memory area.
+
+Error checking: None.
+
+Sample call: uint8_t gen[RS_MAX_PARITY + 1];
+	     rsGenerator(16, gen);
+********************************************/
+void rsGenerator(int, uint8_t*);
+
+/********************************************
+Function: rsEncode(uint8_t*, int, uint8_t*, int, uint8_t*)
+
+Purpose: Computes the parity bytes for the given message.
+	 The message together with the parity bytes forms
+	 a systematic codeword.
+
+Inputs: The message, the lenght of the message, the generator
+	polynomial as given by rsGenerator(), the amount of parity
+	bytes and a memory area for the parity bytes.
+	The lenght of the message plus the amount of parity
+	bytes must not be greater than RS_MAX_CODEWORD.
+
+Returns: Nothing.
+
+Modifies: Overwrites the memory area given for the parity bytes.
+
+Error checking: None.
+
+Sample call: rsEncode(message, 200, gen, 16, &message[200]);
+********************************************/
+void rsEncode(uint8_t*, int, uint8_t*, int, uint8_t*);
+
+/********************************************
+Function: rsDecode(uint8_t*, int, int)
+
+Purpose: Finds and corrects the errors in the given codeword.
+	 Atmost parity / 2 erroneous bytes can be corrected.
+
+Inputs: The codeword (message followed by parity bytes), the
+	lenght of the whole codeword and the amount of parity
+	bytes in it.
+
+Returns: The amount of bytes corrected or -1 if the codeword
+	 had too many errors to be corrected.
+
+Modifies: The erroneous bytes in the codeword are corrected
+	  in place. If -1 is returned the codeword is left
+	  untouched.
+
+Error checking: Checks that the corrected codeword is valid
+		before modifying the given one.
+
+Sample call: if(rsDecode(codeword, 216, 16) < 0)
+		...the data could not be recovered...
+********************************************/
+int rsDecode(uint8_t*, int, int);
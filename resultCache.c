@@ -0,0 +1,389 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "resultCache.h"
+
+//The amount of bytes copied at a time when the kernel can not copy the file.
+#define COPY_BUFFER (1 << 16)
+
+//Makes the names of the temporary files unique within the process.
+static unsigned int temporaryCount = 0;
+
+//The real time in nanoseconds, used as the time of the last use.
+static int64_t now(){
+	struct timespec t;
+
+	clock_gettime(CLOCK_REALTIME, &t);
+	return (int64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static void entryPath(RESULT_CACHE* cache, uint64_t key, char* path){
+	snprintf(path, CACHE_PATH_LENGTH + 32, "%s/%016llx", cache->directory, (unsigned long long) key);
+}
+
+//A temporary file next to the given path, created exclusively.
+//Returns the descriptor or -1.
+static int createTemporary(RESULT_CACHE* cache, const char* path, char* temporary){
+	pthread_mutex_lock(&cache->lock);
+	unsigned int count = temporaryCount++;
+	pthread_mutex_unlock(&cache->lock);
+
+	snprintf(temporary, CACHE_PATH_LENGTH + 64, "%s.%ld.%u.tmp", path, (long) getpid(), count);
+	return open(temporary, O_WRONLY | O_CREAT | O_EXCL, 0666);
+}
+
+static long findEntry(RESULT_CACHE* cache, uint64_t key){
+	for(size_t i = 0; i < cache->count; i++)
+		if(cache->entries[i].key == key)
+			return (long) i;
+	return -1;
+}
+
+static void forget(RESULT_CACHE* cache, size_t i){
+	if(cache->entries[i].contents != NULL){
+		free(cache->entries[i].contents);
+		cache->memory -= cache->entries[i].size;
+	}
+	cache->size -= cache->entries[i].size;
+	cache->entries[i] = cache->entries[--cache->count];
+}
+
+static size_t leastUsed(RESULT_CACHE* cache, int inMemory){
+	size_t oldest = cache->count;
+
+	for(size_t i = 0; i < cache->count; i++)
+		if((!inMemory || cache->entries[i].contents != NULL) &&
+			(oldest == cache->count || cache->entries[i].used < cache->entries[oldest].used))
+			oldest = i;
+	return oldest;
+}
+
+//Removes the least recently used results until the given amount
+//of bytes fits the limit.
+static void evict(RESULT_CACHE* cache, uint64_t needed){
+	char path[CACHE_PATH_LENGTH + 32];
+
+	while(cache->count > 0 && cache->size + needed > cache->limit){
+		size_t oldest = leastUsed(cache, 0);
+
+		entryPath(cache, cache->entries[oldest].key, path);
+		unlink(path);
+		forget(cache, oldest);
+	}
+}
+
+//Drops the least recently used results from memory until the rest
+//fit the memory limit. The files are kept.
+static void trimMemory(RESULT_CACHE* cache){
+	while(cache->memory > CACHE_MEMORY_LIMIT){
+		size_t oldest = leastUsed(cache, 1);
+
+		free(cache->entries[oldest].contents);
+		cache->entries[oldest].contents = NULL;
+		cache->memory -= cache->entries[oldest].size;
+	}
+}
+
+static int addEntry(RESULT_CACHE* cache, uint64_t key, uint64_t size, int64_t used){
+	if(cache->count == cache->slots){
+		size_t slots = cache->slots ? 2 * cache->slots : 64;
+		CACHE_ENTRY* grown = realloc(cache->entries, slots * sizeof(CACHE_ENTRY));
+		if(grown == NULL)
+			return 0;
+
+		cache->entries = grown;
+		cache->slots = slots;
+	}
+	cache->entries[cache->count].key = key;
+	cache->entries[cache->count].size = size;
+	cache->entries[cache->count].used = used;
+	cache->entries[cache->count++].contents = NULL;
+	cache->size += size;
+	return 1;
+}
+
+//Marks the result used, also in the modification time of its file.
+static void touch(RESULT_CACHE* cache, size_t i){
+	char path[CACHE_PATH_LENGTH + 32];
+	int64_t used = now();
+	struct timespec times[2] = {{0, UTIME_OMIT}, {used / 1000000000, used % 1000000000}};
+
+	cache->entries[i].used = used;
+	entryPath(cache, cache->entries[i].key, path);
+	utimensat(AT_FDCWD, path, times, 0);
+}
+
+//Copies the rest of the input to the output. The kernel copies the
+//data when it can, without passing it through this process.
+static int copyDescriptor(int in, int out){
+	uint8_t* buffer;
+	ssize_t copied;
+
+	while((copied = copy_file_range(in, NULL, out, NULL, 1 << 30, 0)) > 0);
+	if(copied == 0)
+		return 1;
+	if(errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP)
+		return 0;
+
+	if((buffer = malloc(COPY_BUFFER)) == NULL)
+		return 0;
+	while((copied = read(in, buffer, COPY_BUFFER)) > 0){
+		for(ssize_t written = 0, w; written < copied; written += w)
+			if((w = write(out, buffer + written, copied - written)) <= 0){
+				free(buffer);
+				return 0;
+			}
+	}
+	free(buffer);
+	return copied == 0;
+}
+
+//Copies the input to the given path through a temporary file, so the
+//path holds either the complete copy or what it held before.
+static int copyTo(RESULT_CACHE* cache, int in, const char* path){
+	char temporary[CACHE_PATH_LENGTH + 64];
+	int out = createTemporary(cache, path, temporary);
+
+	if(out < 0)
+		return 0;
+
+	int success = copyDescriptor(in, out);
+	if(close(out) != 0)
+		success = 0;
+	if(success && rename(temporary, path) != 0)
+		success = 0;
+	if(!success)
+		unlink(temporary);
+	return success;
+}
+
+//Adds the file just written to the given temporary path to the cache.
+static int commit(RESULT_CACHE* cache, uint64_t key, const char* temporary, uint64_t size){
+	char path[CACHE_PATH_LENGTH + 32];
+
+	entryPath(cache, key, path);
+
+	pthread_mutex_lock(&cache->lock);
+	long found = findEntry(cache, key);
+	if(found >= 0)
+		forget(cache, found);
+
+	evict(cache, size);
+	int success = rename(temporary, path) == 0 && addEntry(cache, key, size, now());
+	pthread_mutex_unlock(&cache->lock);
+
+	if(!success)
+		unlink(temporary);
+	return success;
+}
+
+RESULT_CACHE* openCache(char* directory, uint64_t limit){
+	RESULT_CACHE* cache = calloc(1, sizeof(RESULT_CACHE));
+	struct dirent* file;
+
+	if(cache == NULL)
+		return NULL;
+
+	pthread_mutex_init(&cache->lock, NULL);
+	snprintf(cache->directory, CACHE_PATH_LENGTH, "%s", directory);
+	cache->limit = limit > 0 ? limit : CACHE_DEFAULT_LIMIT;
+
+	DIR* listing;
+	if((mkdir(directory, 0777) != 0 && errno != EEXIST) || (listing = opendir(directory)) == NULL){
+		cache->error = CACHE_DIRECTORY_ERROR;
+		return cache;
+	}
+
+	//The results are the files named after a key.
+	while((file = readdir(listing)) != NULL){
+		char path[CACHE_PATH_LENGTH + 32], *end;
+		unsigned long long key = strtoull(file->d_name, &end, 16);
+		struct stat info;
+
+		if(strlen(file->d_name) != 16 || *end != '\0')
+			continue;
+
+		entryPath(cache, key, path);
+		if(stat(path, &info) != 0 || !S_ISREG(info.st_mode))
+			continue;
+
+		if(!addEntry(cache, key, info.st_size, (int64_t) info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec)){
+			closedir(listing);
+			cache->error = CACHE_MEMORY_ERROR;
+			return cache;
+		}
+	}
+	closedir(listing);
+
+	evict(cache, 0);
+	cache->error = CACHE_OK;
+	return cache;
+}
+
+//Opens the file of the result and marks it used. Returns the
+//descriptor, or -1 if the result is not in the cache.
+static int openEntry(RESULT_CACHE* cache, uint64_t key, uint64_t* size){
+	char path[CACHE_PATH_LENGTH + 32];
+	int fd = -1;
+
+	entryPath(cache, key, path);
+	long found = findEntry(cache, key);
+	if(found >= 0){
+		//An other process may have removed the file.
+		if((fd = open(path, O_RDONLY)) < 0)
+			forget(cache, found);
+		else{
+			*size = cache->entries[found].size;
+			touch(cache, found);
+		}
+	}
+	if(fd < 0)
+		cache->misses++;
+	else
+		cache->hits++;
+	return fd;
+}
+
+int cacheFetch(RESULT_CACHE* cache, uint64_t key, char* target){
+	uint64_t size;
+
+	pthread_mutex_lock(&cache->lock);
+	int fd = openEntry(cache, key, &size);
+	pthread_mutex_unlock(&cache->lock);
+
+	if(fd < 0)
+		return 0;
+
+	int success = copyTo(cache, fd, target);
+	close(fd);
+	return success;
+}
+
+uint8_t* cacheLoad(RESULT_CACHE* cache, uint64_t key, uint32_t* length){
+	uint8_t* result = NULL;
+	uint64_t size;
+
+	pthread_mutex_lock(&cache->lock);
+	long found = findEntry(cache, key);
+	if(found >= 0 && cache->entries[found].contents != NULL){
+		size = cache->entries[found].size;
+		if((result = malloc(size > 0 ? size : 1)) != NULL){
+			memcpy(result, cache->entries[found].contents, size);
+			*length = (uint32_t) size;
+			touch(cache, found);
+			cache->hits++;
+		}
+		pthread_mutex_unlock(&cache->lock);
+		return result;
+	}
+	int fd = openEntry(cache, key, &size);
+	pthread_mutex_unlock(&cache->lock);
+
+	if(fd < 0)
+		return NULL;
+
+	if(size <= UINT32_MAX && (result = malloc(size > 0 ? size : 1)) != NULL){
+		uint64_t done = 0;
+		ssize_t amount = 1;
+
+		while(done < size && (amount = read(fd, result + done, size - done)) > 0)
+			done += amount;
+		if(done < size){
+			free(result);
+			result = NULL;
+		}
+	}
+	close(fd);
+
+	if(result == NULL)
+		return NULL;
+	*length = (uint32_t) size;
+
+	//The small results are kept in memory for the next time.
+	if(size <= CACHE_MEMORY_ENTRY){
+		uint8_t* copy = malloc(size > 0 ? size : 1);
+
+		pthread_mutex_lock(&cache->lock);
+		found = findEntry(cache, key);
+		if(copy != NULL && found >= 0 && cache->entries[found].contents == NULL && cache->entries[found].size == size){
+			memcpy(copy, result, size);
+			cache->entries[found].contents = copy;
+			cache->memory += size;
+			copy = NULL;
+			trimMemory(cache);
+		}
+		pthread_mutex_unlock(&cache->lock);
+		free(copy);
+	}
+	return result;
+}
+
+int cacheStoreFile(RESULT_CACHE* cache, uint64_t key, char* source){
+	char path[CACHE_PATH_LENGTH + 32], temporary[CACHE_PATH_LENGTH + 64];
+	struct stat info;
+	int in = open(source, O_RDONLY);
+
+	if(in < 0)
+		return 0;
+	if(fstat(in, &info) != 0 || (uint64_t) info.st_size > cache->limit){
+		close(in);
+		return 0;
+	}
+
+	entryPath(cache, key, path);
+	int out = createTemporary(cache, path, temporary);
+	if(out < 0){
+		close(in);
+		return 0;
+	}
+
+	int success = copyDescriptor(in, out);
+	close(in);
+	if(close(out) != 0 || !success){
+		unlink(temporary);
+		return 0;
+	}
+	return commit(cache, key, temporary, info.st_size);
+}
+
+int cacheStore(RESULT_CACHE* cache, uint64_t key, uint8_t* bytes, uint32_t length){
+	char path[CACHE_PATH_LENGTH + 32], temporary[CACHE_PATH_LENGTH + 64];
+
+	if(length > cache->limit)
+		return 0;
+
+	entryPath(cache, key, path);
+	int out = createTemporary(cache, path, temporary);
+	if(out < 0)
+		return 0;
+
+	uint32_t done = 0;
+	ssize_t amount = 1;
+	while(done < length && (amount = write(out, bytes + done, length - done)) > 0)
+		done += amount;
+
+	if(close(out) != 0 || done < length){
+		unlink(temporary);
+		return 0;
+	}
+	return commit(cache, key, temporary, length);
+}
+
+void closeCache(RESULT_CACHE* cache){
+	if(cache == NULL)
+		return;
+
+	for(size_t i = 0; i < cache->count; i++)
+		free(cache->entries[i].contents);
+	free(cache->entries);
+
+	pthread_mutex_destroy(&cache->lock);
+	free(cache);
+}
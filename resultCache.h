@@ -0,0 +1,216 @@
+#include <stdint.h>
+#include <pthread.h>
+/*
+Purpose:
+	This modul keeps the results of earlier operations, so
+	that an operation repeated with the same input does not
+	have to be done again. A result is stored under a 64 bit
+	key, wich should be a hash of everything the result
+	depends on.
+	The results are stored as files in a cache directory,
+	named after their keys, so they are kept between runs
+	and can be shared by several processes. The small
+	results are also kept in memory.
+	The total size of the files is kept under a limit by
+	removing the least recently used results. The time of
+	the last use is kept as the modification time of the
+	file, so the order is remembered between runs.
+
+Functions:
+	RESULT_CACHE* openCache(char*, uint64_t)
+	int cacheFetch(RESULT_CACHE*, uint64_t, char*)
+	uint8_t* cacheLoad(RESULT_CACHE*, uint64_t, uint32_t*)
+	int cacheStoreFile(RESULT_CACHE*, uint64_t, char*)
+	int cacheStore(RESULT_CACHE*, uint64_t, uint8_t*, uint32_t)
+	void closeCache(RESULT_CACHE*)
+
+Dependancies: None.
+*/
+
+//The size limit of the cache used if none is given.
+#define CACHE_DEFAULT_LIMIT (1ULL << 30)
+
+//The largest result kept in memory.
+#define CACHE_MEMORY_ENTRY (1 << 20)
+
+//The total size of the results kept in memory.
+#define CACHE_MEMORY_LIMIT (32 << 20)
+
+//The longest path of the cache directory.
+#define CACHE_PATH_LENGTH 4096
+
+/********************************************
+Enum: CACHE_ERROR
+
+Purpose: The different error conditions the functions
+	 of this modul can run into.
+********************************************/
+typedef enum{
+	CACHE_OK,					//No error
+	CACHE_DIRECTORY_ERROR,		//The cache directory could not be created or read
+	CACHE_MEMORY_ERROR			//A malloc operation returned NULL
+}CACHE_ERROR;
+
+/********************************************
+Struct: CACHE_ENTRY
+
+Purpose: Describes a result stored in the cache.
+********************************************/
+typedef struct{
+	uint64_t key;				//The key of the result
+	uint64_t size;				//The size of the result in bytes
+	int64_t used;				//The time of the last use in nanoseconds
+	uint8_t* contents;			//The result kept in memory, or NULL
+}CACHE_ENTRY;
+
+/********************************************
+Struct: RESULT_CACHE
+
+Purpose: Holds the state of a cache.
+
+Usage: You should not change these values manually, use
+       the functions of this modul instead.
+********************************************/
+typedef struct{
+	char directory[CACHE_PATH_LENGTH];	//The cache directory
+	uint64_t limit;						//The largest total size of the results
+	uint64_t size;						//The total size of the results
+	uint64_t memory;					//The total size of the results kept in memory
+
+	pthread_mutex_t lock;				//Protects the entries
+	CACHE_ENTRY* entries;				//The results in the cache
+	size_t count;						//The amount of results
+	size_t slots;						//The size of the entries array
+
+	uint64_t hits;						//The amount of results found
+	uint64_t misses;					//The amount of results not found
+
+	CACHE_ERROR error;					//The error in the last operation
+}RESULT_CACHE;
+
+/********************************************
+Function: openCache(char*, uint64_t)
+
+Purpose: Opens the cache in the given directory. The directory
+	 is created if it does not exist.
+
+Inputs: The directory and the largest total size of the
+	results in bytes, 0 for CACHE_DEFAULT_LIMIT.
+
+Returns: A pointer to the cache, or NULL if there was not
+	 enough memory. If the error variable of the cache is
+	 not CACHE_OK the cache could not be opened and should
+	 be closed.
+
+Modifies: Reserves memory for the cache, it is freed by the
+	  closeCache()-function. Removes the least recently used
+	  results if the results allready in the directory do not
+	  fit the limit.
+
+Error checking: Reports an error if:
+		the directory could not be created or read,
+		there was not enough memory.
+
+Sample call: RESULT_CACHE* cache = openCache("cache", 0);
+	     if(cache == NULL || cache->error != CACHE_OK)
+		...failure...
+********************************************/
+RESULT_CACHE* openCache(char*, uint64_t);
+
+/********************************************
+Function: cacheFetch(RESULT_CACHE*, uint64_t, char*)
+
+Purpose: Copies the result stored under the given key to
+	 the given file. This function is thread safe.
+
+Inputs: The cache, the key and the name of the file.
+
+Returns: 1 if the result was found and copied, 0 otherwise.
+
+Modifies: Overwrites the given file. Marks the result used.
+
+Error checking: Returns 0 if the copy failed, no partial file
+		is left behind.
+
+Sample call: if(!cacheFetch(cache, key, "encodedBitmap.bmp"))
+		...encode the file...
+********************************************/
+int cacheFetch(RESULT_CACHE*, uint64_t, char*);
+
+/********************************************
+Function: cacheLoad(RESULT_CACHE*, uint64_t, uint32_t*)
+
+Purpose: Reads the result stored under the given key to
+	 memory. This function is thread safe.
+
+Inputs: The cache, the key and a pointer where the lenght of
+	the result is stored.
+
+Returns: A pointer to a copy of the result, or NULL if the
+	 result was not found. The caller must free the copy.
+
+Modifies: Overwrites the value pointed by the last argument.
+	  Marks the result used.
+
+Error checking: Returns NULL if the result could not be read.
+
+Sample call: uint8_t* result = cacheLoad(cache, key, &lenght);
+********************************************/
+uint8_t* cacheLoad(RESULT_CACHE*, uint64_t, uint32_t*);
+
+/********************************************
+Function: cacheStoreFile(RESULT_CACHE*, uint64_t, char*)
+
+Purpose: Stores a copy of the given file under the given key,
+	 replacing a previous result. This function is thread
+	 safe.
+
+Inputs: The cache, the key and the name of the file.
+
+Returns: 1 on success, 0 otherwise.
+
+Modifies: The cache directory. Removes the least recently used
+	  results if the new one does not fit the limit. A result
+	  larger than the whole limit is not stored.
+
+Error checking: Returns 0 if the file could not be copied.
+
+Sample call: cacheStoreFile(cache, key, "encodedBitmap.bmp");
+********************************************/
+int cacheStoreFile(RESULT_CACHE*, uint64_t, char*);
+
+/********************************************
+Function: cacheStore(RESULT_CACHE*, uint64_t, uint8_t*, uint32_t)
+
+Purpose: Stores the given bytes under the given key, replacing
+	 a previous result. This function is thread safe.
+
+Inputs: The cache, the key, the bytes and their lenght.
+
+Returns: 1 on success, 0 otherwise.
+
+Modifies: Same as the cacheStoreFile()-function.
+
+Error checking: Returns 0 if the result could not be written.
+
+Sample call: cacheStore(cache, key, message, lenght);
+********************************************/
+int cacheStore(RESULT_CACHE*, uint64_t, uint8_t*, uint32_t);
+
+/********************************************
+Function: closeCache(RESULT_CACHE*)
+
+Purpose: Frees the memory of the cache. The results stay in
+	 the directory.
+
+Inputs: The cache.
+
+Returns: Nothing.
+
+Modifies: Frees the cache.
+
+Error checking: Does nothing if the cache is NULL.
+
+Sample call: closeCache(cache);
+********************************************/
+void closeCache(RESULT_CACHE*);
@@ -0,0 +1,245 @@
+#include <string.h>
+#include <math.h>
+#include "steganalysis.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//The chi-square probability above wich a prefix is considered embedded.
+#define CHI_THRESHOLD 0.95
+
+//Categories expecting fewer values than this are left out of the test.
+#define CHI_MIN_EXPECTED 5.0
+
+void analysisInit(LSB_ANALYSIS* state, uint64_t total){
+	memset(state, 0, sizeof(LSB_ANALYSIS));
+	state->total = total;
+}
+
+/*
+ * Sample pair analysis classifies pairs (u, v) of bytes of the same
+ * colour channel:
+ * x counts pairs where v is even and u < v, or v is odd and u > v,
+ * y counts pairs where v is even and u > v, or v is odd and u < v,
+ * k counts pairs where u and v differ only in the last bit.
+ */
+static void countPair(LSB_ANALYSIS* state, uint8_t u, uint8_t v){
+	if(v & 1){
+		state->x += u > v;
+		state->y += u < v;
+	}
+	else{
+		state->x += u < v;
+		state->y += u > v;
+	}
+	state->k += (u >> 1) == (v >> 1);
+	state->pairs++;
+}
+
+//Counts the pairs completely within the given data.
+static void countPairs(LSB_ANALYSIS* state, const uint8_t* data, size_t length){
+	size_t i = 0;
+
+#ifdef __SSE2__
+	const __m128i one = _mm_set1_epi8(1),
+				  high = _mm_set1_epi8((char) 0xFE),
+				  zero = _mm_setzero_si128();
+	uint64_t x = 0, y = 0, k = 0, pairs = 0;
+
+	for(; i + PAIR_DISTANCE + 16 <= length; i += 16){
+		__m128i u = _mm_loadu_si128((const __m128i*) &data[i]),
+				v = _mm_loadu_si128((const __m128i*) &data[i + PAIR_DISTANCE]),
+				max = _mm_max_epu8(u, v),
+				equal = _mm_cmpeq_epi8(u, v),
+				less = _mm_andnot_si128(equal, _mm_cmpeq_epi8(max, v)),
+				greater = _mm_andnot_si128(equal, _mm_cmpeq_epi8(max, u)),
+				even = _mm_cmpeq_epi8(_mm_and_si128(v, one), zero),
+				inX = _mm_or_si128(_mm_and_si128(even, less), _mm_andnot_si128(even, greater)),
+				inY = _mm_or_si128(_mm_and_si128(even, greater), _mm_andnot_si128(even, less)),
+				inK = _mm_cmpeq_epi8(_mm_and_si128(_mm_xor_si128(u, v), high), zero);
+
+		x += __builtin_popcount(_mm_movemask_epi8(inX));
+		y += __builtin_popcount(_mm_movemask_epi8(inY));
+		k += __builtin_popcount(_mm_movemask_epi8(inK));
+		pairs += 16;
+	}
+	state->x += x;
+	state->y += y;
+	state->k += k;
+	state->pairs += pairs;
+#endif
+	for(; i + PAIR_DISTANCE < length; i++)
+		countPair(state, data[i], data[i + PAIR_DISTANCE]);
+}
+
+//Adds the given data to the histogram of a single segment. Four
+//tables are used so that repeated values do not stall each other.
+static void countValues(uint64_t* histogram, const uint8_t* data, size_t length){
+	uint32_t tables[4][256] = {{0}};
+	size_t i = 0;
+
+	for(; i + 4 <= length; i += 4){
+		tables[0][data[i]]++;
+		tables[1][data[i + 1]]++;
+		tables[2][data[i + 2]]++;
+		tables[3][data[i + 3]]++;
+	}
+	for(; i < length; i++)
+		tables[0][data[i]]++;
+
+	for(int v = 0; v < 256; v++)
+		histogram[v] += (uint64_t) tables[0][v] + tables[1][v] + tables[2][v] + tables[3][v];
+}
+
+void analysisUpdate(LSB_ANALYSIS* state, const uint8_t* data, size_t length){
+	//The pairs with their first byte in the previous piece.
+	for(int j = 0; j < PAIR_DISTANCE && (size_t) j < length; j++){
+		int t = state->tailLength + j - PAIR_DISTANCE;
+		if(t >= 0)
+			countPair(state, state->tail[t], data[j]);
+	}
+	countPairs(state, data, length);
+
+	//Saves the last bytes for the pairs reaching to the next piece.
+	uint8_t joined[2 * PAIR_DISTANCE];
+	int joinedLength = state->tailLength;
+	memcpy(joined, state->tail, state->tailLength);
+	for(size_t i = length > PAIR_DISTANCE ? length - PAIR_DISTANCE : 0; i < length; i++)
+		joined[joinedLength++] = data[i];
+	state->tailLength = joinedLength < PAIR_DISTANCE ? joinedLength : PAIR_DISTANCE;
+	memcpy(state->tail, &joined[joinedLength - state->tailLength], state->tailLength);
+
+	//The piece is split to the segments it overlaps.
+	while(length > 0){
+		uint64_t segment = state->total ? state->seen * CHI_SEGMENTS / state->total : 0;
+		size_t amount = length;
+
+		if(segment >= CHI_SEGMENTS - 1)
+			segment = CHI_SEGMENTS - 1;
+		else{
+			uint64_t end = ((segment + 1) * state->total + CHI_SEGMENTS - 1) / CHI_SEGMENTS;
+			if(end - state->seen < amount)
+				amount = end - state->seen;
+		}
+		countValues(state->histogram[segment], data, amount);
+		state->seen += amount;
+		data += amount;
+		length -= amount;
+	}
+}
+
+//The regularized upper incomplete gamma function Q(a, x).
+static double gammaQ(double a, double x){
+	if(x <= 0)
+		return 1;
+
+	double logPrefix = -x + a * log(x) - lgamma(a);
+
+	if(x < a + 1){
+		//Series for P(a, x)
+		double sum = 1 / a, term = sum;
+		for(int n = 1; n < 1000; n++){
+			term *= x / (a + n);
+			sum += term;
+			if(fabs(term) < fabs(sum) * 1e-15)
+				break;
+		}
+		return 1 - sum * exp(logPrefix);
+	}
+
+	//Continued fraction for Q(a, x) with Lentz's method
+	double b = x + 1 - a, c = 1e300, d = 1 / b, h = d;
+	for(int n = 1; n < 1000; n++){
+		double an = -n * (n - a);
+		b += 2;
+		d = an * d + b;
+		if(fabs(d) < 1e-300)
+			d = 1e-300;
+		c = b + an / c;
+		if(fabs(c) < 1e-300)
+			c = 1e-300;
+		d = 1 / d;
+		double delta = d * c;
+		h *= delta;
+		if(fabs(delta - 1) < 1e-15)
+			break;
+	}
+	return exp(logPrefix) * h;
+}
+
+//The probability that the value pairs of the histogram have been equalized.
+static double chiSquare(uint64_t* histogram){
+	double chi = 0;
+	int categories = 0;
+
+	for(int i = 0; i < 256; i += 2){
+		double expected = (histogram[i] + histogram[i + 1]) / 2.0;
+		if(expected < CHI_MIN_EXPECTED)
+			continue;
+
+		double difference = histogram[i] - expected;
+		chi += difference * difference / expected;
+		categories++;
+	}
+	if(categories < 2)
+		return 0;
+
+	return gammaQ((categories - 1) / 2.0, chi / 2);
+}
+
+void analysisFinish(LSB_ANALYSIS* state, LSB_REPORT* report){
+	uint64_t prefix[256] = {0};
+	int embedded = 0;
+
+	memset(report, 0, sizeof(LSB_REPORT));
+
+	for(int s = 0; s < CHI_SEGMENTS; s++){
+		for(int v = 0; v < 256; v++)
+			prefix[v] += state->histogram[s][v];
+
+		double p = chiSquare(prefix);
+		if(s == 0)
+			report->chiProbability = p;
+
+		if(p < CHI_THRESHOLD)
+			break;
+		embedded++;
+	}
+	report->chiExtent = (double) embedded / CHI_SEGMENTS;
+
+	//The estimate is the smaller root of
+	//(k / 2) p^2 + (2x - n) p + (y - x) = 0
+	double a = state->k / 2.0,
+		   b = 2.0 * state->x - (double) state->pairs,
+		   c = (double) state->y - (double) state->x,
+		   estimate = 0;
+
+	if(a > 0){
+		double discriminant = b * b - 4 * a * c;
+		if(discriminant < 0)
+			discriminant = 0;
+
+		double root1 = (-b + sqrt(discriminant)) / (2 * a),
+			   root2 = (-b - sqrt(discriminant)) / (2 * a);
+		estimate = root1 < root2 ? root1 : root2;
+	}
+	else if(b != 0)
+		estimate = -c / b;
+
+	if(estimate < 0)
+		estimate = 0;
+	if(estimate > 1)
+		estimate = 1;
+	report->pairEstimate = estimate;
+
+	report->score = report->pairEstimate > report->chiExtent ? report->pairEstimate : report->chiExtent;
+}
+
+void analyseData(const uint8_t* data, size_t length, LSB_REPORT* report){
+	LSB_ANALYSIS state;
+
+	analysisInit(&state, length);
+	analysisUpdate(&state, data, length);
+	analysisFinish(&state, report);
+}
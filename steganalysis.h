@@ -0,0 +1,152 @@
+#include <stdint.h>
+#include <stddef.h>
+/*
+Purpose:
+	This modul contains statistical tests for detecting
+	messages hidden to the last bits of bitmap data by
+	any program, not just this one.
+
+	Two tests are used:
+	The chi-square attack (Westfeld & Pfitzmann) checks
+	whether the counts of the byte values 2i and 2i+1
+	have been equalized, wich is what replacing the last
+	bits with message bits does. As messages are usually
+	embedded from the beginning of the data, the test is
+	computed for growing prefixes of the data and the
+	lenght of the prefix where the test still fires is
+	reported.
+	Sample pair analysis (Dumitrescu, Wu & Wang, in the
+	simplified form by Ker) estimates the share of bytes
+	carrying message bits from the relations of neighbouring
+	bytes of the same colour channel, and also detects
+	messages spread over the whole image.
+
+	The data is analysed in a single streaming pass so it
+	can be given in pieces of any size. The pair counts are
+	computed 16 bytes at a time with SSE2 when available.
+
+Functions:
+	void analysisInit(LSB_ANALYSIS*, uint64_t)
+	void analysisUpdate(LSB_ANALYSIS*, const uint8_t*, size_t)
+	void analysisFinish(LSB_ANALYSIS*, LSB_REPORT*)
+	void analyseData(const uint8_t*, size_t, LSB_REPORT*)
+
+Dependancies: None.
+*/
+
+//The amount of prefixes the chi-square test is computed for.
+#define CHI_SEGMENTS 32
+
+//The distance of neighbouring bytes of the same colour channel.
+#define PAIR_DISTANCE 3
+
+/********************************************
+Struct: LSB_REPORT
+
+Purpose: Holds the results of the analysis. All the values
+	 are between 0 and 1, larger values meaning a hidden
+	 message is more likely.
+********************************************/
+typedef struct{
+	double chiProbability;	//Chi-square probability of embedding in the first prefix
+	double chiExtent;		//Share of the data where the chi-square test fires
+	double pairEstimate;	//Share of bytes carrying a message estimated by sample pair analysis
+	double score;			//The combined score of the tests
+}LSB_REPORT;
+
+/********************************************
+Struct: LSB_ANALYSIS
+
+Purpose: Holds the state of a streaming analysis.
+
+Usage: You should not change these values manually, use
+       the functions of this modul instead.
+********************************************/
+typedef struct{
+	uint64_t total;						//The amount of bytes to be analysed
+	uint64_t seen;						//The amount of bytes analysed so far
+	uint64_t histogram[CHI_SEGMENTS][256];	//Value counts for each segment of the data
+
+	uint64_t pairs;						//The amount of byte pairs
+	uint64_t x, y, k;					//The pair counts used by sample pair analysis
+
+	uint8_t tail[PAIR_DISTANCE];		//The last bytes of the previous piece
+	int tailLength;						//The amount of bytes in tail
+}LSB_ANALYSIS;
+
+/********************************************
+Function: analysisInit(LSB_ANALYSIS*, uint64_t)
+
+Purpose: Starts a new streaming analysis.
+
+Inputs: The struct holding the analysis state and the total
+	amount of bytes that will be analysed.
+
+Returns: Nothing.
+
+Modifies: Overwrites the given struct.
+
+Error checking: None.
+
+Sample call: LSB_ANALYSIS state;
+	     analysisInit(&state, dataSize(file));
+********************************************/
+void analysisInit(LSB_ANALYSIS*, uint64_t);
+
+/********************************************
+Function: analysisUpdate(LSB_ANALYSIS*, const uint8_t*, size_t)
+
+Purpose: Adds the next piece of data to the analysis.
+
+Inputs: The analysis state, the data and the lenght of the data.
+	The pieces must be given in order and their total
+	lenght should match the lenght given to analysisInit().
+
+Returns: Nothing.
+
+Modifies: Updates the given analysis state.
+
+Error checking: Bytes exceeding the total lenght given to
+		analysisInit() are counted to the last prefix.
+
+Sample call: analysisUpdate(&state, buffer, read);
+********************************************/
+void analysisUpdate(LSB_ANALYSIS*, const uint8_t*, size_t);
+
+/********************************************
+Function: analysisFinish(LSB_ANALYSIS*, LSB_REPORT*)
+
+Purpose: Computes the test results from the analysis state.
+
+Inputs: The analysis state and the struct where the results
+	should be stored.
+
+Returns: Nothing.
+
+Modifies: Overwrites the given report.
+
+Error checking: Tests without enough data to be computed
+		report 0.
+
+Sample call: LSB_REPORT report;
+	     analysisFinish(&state, &report);
+********************************************/
+void analysisFinish(LSB_ANALYSIS*, LSB_REPORT*);
+
+/********************************************
+Function: analyseData(const uint8_t*, size_t, LSB_REPORT*)
+
+Purpose: Analyses the given data in one call.
+
+Inputs: The data, the lenght of the data and the struct where
+	the results should be stored.
+
+Returns: Nothing.
+
+Modifies: Overwrites the given report.
+
+Error checking: None.
+
+Sample call: analyseData(file->data, dataSize(file), &report);
+********************************************/
+void analyseData(const uint8_t*, size_t, LSB_REPORT*);
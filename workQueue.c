@@ -0,0 +1,99 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <unistd.h>
+#include "workQueue.h"
+
+static void* worker(void* argument){
+	WORK_QUEUE* queue = argument;
+
+	pthread_mutex_lock(&queue->lock);
+	for(;;){
+		while(queue->first == NULL && !queue->closing)
+			pthread_cond_wait(&queue->available, &queue->lock);
+
+		//The items left in the queue are handled before stopping.
+		WORK_ITEM* next = queue->first;
+		if(next == NULL)
+			break;
+
+		queue->first = next->next;
+		if(queue->first == NULL)
+			queue->last = NULL;
+
+		pthread_mutex_unlock(&queue->lock);
+		queue->work(queue->context, next->item);
+		free(next);
+		pthread_mutex_lock(&queue->lock);
+	}
+	pthread_mutex_unlock(&queue->lock);
+	return NULL;
+}
+
+WORK_QUEUE* createQueue(int workers, void (*work)(void*, void*), void* context){
+	WORK_QUEUE* queue = calloc(1, sizeof(WORK_QUEUE));
+
+	if(queue == NULL)
+		return NULL;
+
+	if(workers <= 0)
+		workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if(workers <= 0)
+		workers = 1;
+	if(workers > QUEUE_MAX_WORKERS)
+		workers = QUEUE_MAX_WORKERS;
+
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->available, NULL);
+	queue->work = work;
+	queue->context = context;
+
+	for(queue->workers = 0; queue->workers < workers; queue->workers++)
+		if(pthread_create(&queue->threads[queue->workers], NULL, worker, queue) != 0)
+			break;
+
+	if(queue->workers == 0){
+		pthread_mutex_destroy(&queue->lock);
+		pthread_cond_destroy(&queue->available);
+		free(queue);
+		return NULL;
+	}
+	return queue;
+}
+
+int pushWork(WORK_QUEUE* queue, void* item){
+	WORK_ITEM* next = malloc(sizeof(WORK_ITEM));
+
+	if(next == NULL)
+		return 0;
+
+	next->item = item;
+	next->next = NULL;
+
+	pthread_mutex_lock(&queue->lock);
+	if(queue->last != NULL)
+		queue->last->next = next;
+	else
+		queue->first = next;
+	queue->last = next;
+	pthread_cond_signal(&queue->available);
+	pthread_mutex_unlock(&queue->lock);
+
+	return 1;
+}
+
+void destroyQueue(WORK_QUEUE* queue){
+	if(queue == NULL)
+		return;
+
+	pthread_mutex_lock(&queue->lock);
+	queue->closing = 1;
+	pthread_cond_broadcast(&queue->available);
+	pthread_mutex_unlock(&queue->lock);
+
+	for(int i = 0; i < queue->workers; i++)
+		pthread_join(queue->threads[i], NULL);
+
+	pthread_mutex_destroy(&queue->lock);
+	pthread_cond_destroy(&queue->available);
+	free(queue);
+}
@@ -0,0 +1,110 @@
+#include <pthread.h>
+/*
+Purpose:
+	This modul runs work items on a pool of threads.
+	Items are pushed to a queue from any thread and
+	handled by the worker threads in the order they
+	were pushed.
+
+Functions:
+	WORK_QUEUE* createQueue(int, void (*)(void*, void*), void*)
+	int pushWork(WORK_QUEUE*, void*)
+	void destroyQueue(WORK_QUEUE*)
+
+Dependancies: None.
+*/
+
+//The largest amount of worker threads in a queue.
+#define QUEUE_MAX_WORKERS 256
+
+/********************************************
+Struct: WORK_ITEM
+
+Purpose: A single item waiting in the queue.
+********************************************/
+typedef struct WORK_ITEM{
+	void* item;					//The item given to the work function
+	struct WORK_ITEM* next;		//The next item in the queue
+}WORK_ITEM;
+
+/********************************************
+Struct: WORK_QUEUE
+
+Purpose: Holds the queue and the worker threads.
+
+Usage: You should not change these values manually, use
+       the functions of this modul instead.
+********************************************/
+typedef struct{
+	pthread_mutex_t lock;				//Protects the rest of the values
+	pthread_cond_t available;			//Signalled when an item is pushed
+	WORK_ITEM* first;					//The next item to be handled
+	WORK_ITEM* last;					//The item pushed last
+	int closing;						//Is 1 when the queue is being destroyed
+
+	void (*work)(void* context, void* item);	//Handles a single item
+	void* context;						//Given to the work function
+
+	int workers;						//The amount of worker threads
+	pthread_t threads[QUEUE_MAX_WORKERS];	//The worker threads
+}WORK_QUEUE;
+
+/********************************************
+Function: createQueue(int, void (*)(void*, void*), void*)
+
+Purpose: Creates a queue and starts its worker threads.
+
+Inputs: The amount of worker threads (0 or less for one for
+	each processor), the function handling the items and the
+	context given to the function.
+	The function is called from the worker threads so it must
+	be thread safe. It owns the item it is given.
+
+Returns: A pointer to the queue or NULL on failure.
+
+Modifies: Reserves memory for the queue, it is freed by the
+	  destroyQueue()-function.
+
+Error checking: Returns NULL if the memory allocation or
+		starting the first thread failed. If only some of
+		the threads could be started, the queue runs with
+		those.
+
+Sample call: WORK_QUEUE* queue = createQueue(0, handleFile, &settings);
+********************************************/
+WORK_QUEUE* createQueue(int, void (*)(void*, void*), void*);
+
+/********************************************
+Function: pushWork(WORK_QUEUE*, void*)
+
+Purpose: Adds an item to the end of the queue.
+
+Inputs: The queue and the item.
+
+Returns: 1 on success 0 if there was not enough memory.
+
+Modifies: The queue.
+
+Error checking: None.
+
+Sample call: pushWork(queue, path);
+********************************************/
+int pushWork(WORK_QUEUE*, void*);
+
+/********************************************
+Function: destroyQueue(WORK_QUEUE*)
+
+Purpose: Waits for the items in the queue to be handled,
+	 stops the worker threads and frees the queue.
+
+Inputs: The queue.
+
+Returns: Nothing.
+
+Modifies: Frees the queue.
+
+Error checking: Does nothing if the queue is NULL.
+
+Sample call: destroyQueue(queue);
+********************************************/
+void destroyQueue(WORK_QUEUE*);